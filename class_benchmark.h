@@ -0,0 +1,875 @@
+/**
+ * @file class_benchmark.h
+ * @author Italo Soares (italocjs@live.com)
+ * @brief Benchmarks for the geofence class, run them with "myfile.exe --bench" on windows/linux or call benchmark_geofence() on esp32.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+#include "geofence.h"
+#include "geofence_validate.h"
+#include "geofence_overlap.h"
+#include "geofence_distance.h"
+#include "geofence_wgs84.h"
+// the headers below need std::atomic, std::mutex or threads, the plain Arduino harness only builds the tests above
+#if defined(ESP32) || defined(_WIN32) || defined(__linux__)
+#include "geofence_gnss.h"
+#include "geofence_devices.h"
+#include "geofence_async.h"
+#endif
+#if defined(_WIN32) || defined(__linux__)
+#include "geofence_snapshot.h"
+#endif
+#include "class_testing.h"
+
+#if defined(ESP32) || defined(ARDUINO)
+#include "Arduino.h"
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+/**
+ * @brief Monotonic time in nanoseconds (microsecond resolution on esp32/arduino).
+ *
+ * @return double
+ */
+double benchmark_now_ns()
+{
+#if defined(ESP32) || defined(ARDUINO)
+	return micros() * 1000.0;
+#else
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief CPU cycle counter on esp32, 0 elsewhere (use the ns figures there).
+ *
+ * @return uint32_t
+ */
+uint32_t benchmark_cycles()
+{
+#if defined(ESP32)
+	return ESP.getCycleCount();
+#else
+	return 0;
+#endif
+}
+
+volatile double benchmark_sink = 0;    // results are written here so the compiler can't drop the benchmarked calls
+
+/**
+ * @brief Time op(k) for k over the query points, repeating until min_duration_ns has passed, and print ns/op, ops/s and (esp32)
+ * cycles/op.
+ *
+ * @param operation name printed in the report
+ * @param vertices fence size, 0 for operations that don't depend on a fence
+ * @param distribution name of the point distribution
+ * @param points number of query points, op is called with 0 to points - 1
+ * @param op callable returning a double or bool
+ */
+template <typename Operation>
+void benchmark_run(const char *operation, int vertices, const char *distribution, size_t points, Operation op)
+{
+	if (points == 0) return;
+#if defined(ESP32) || defined(ARDUINO)
+	const double min_duration_ns = 50e6;
+#else
+	const double min_duration_ns = 20e6;
+#endif
+	double total = 0;
+	long calls = 0;
+	uint32_t cycles = 0;
+	double start = benchmark_now_ns();
+	double elapsed = 0;
+	do
+	{
+		uint32_t cycles_start = benchmark_cycles();
+		for (size_t k = 0; k < points; k++) total += op(k);
+		cycles += benchmark_cycles() - cycles_start;
+		calls += points;
+		elapsed = benchmark_now_ns() - start;
+	} while (elapsed < min_duration_ns);
+	benchmark_sink = benchmark_sink + total;
+
+	double ns_per_op = elapsed / calls;
+#if defined(ESP32)
+	printf("\t%-42s %7d %-8s %12.1f ns/op %14.0f ops/s %10.0f cycles/op\n", operation, vertices, distribution, ns_per_op,
+	       1e9 / ns_per_op, (double)cycles / calls);
+#else
+	printf("\t%-42s %7d %-8s %12.1f ns/op %14.0f ops/s\n", operation, vertices, distribution, ns_per_op, 1e9 / ns_per_op);
+#endif
+}
+
+/**
+ * @brief Query points around a fence split by where they fall: inside, outside (within twice the bounding box) and near the boundary
+ * (a few centimeters off the middle of an edge, on both sides).
+ */
+class BenchmarkPoints
+{
+   public:
+	std::vector<GPS_Coordinate> inside;
+	std::vector<GPS_Coordinate> outside;
+	std::vector<GPS_Coordinate> near_boundary;
+
+	BenchmarkPoints(const GeoFence &fence, size_t count)
+	{
+		const GeoFence_BoundingBox &box = fence.bounding_box();
+		float lat_span = box.max_latitude - box.min_latitude;
+		float lon_span = box.max_longitude - box.min_longitude;
+		unsigned int seed = 7;
+		auto next_random = [&seed]() -> double
+		{
+			seed = seed * 1103515245 + 12345;
+			return ((seed >> 8) & 0xFFFF) / 65535.0;
+		};
+
+		for (int attempt = 0; attempt < 200000 && (inside.size() < count || outside.size() < count); attempt++)
+		{
+			GPS_Coordinate p(box.min_latitude + (next_random() * 2 - 0.5) * lat_span, box.min_longitude + (next_random() * 2 - 0.5) * lon_span);
+			if (fence.is_inside(p))
+			{
+				if (inside.size() < count) inside.push_back(p);
+			}
+			else if (outside.size() < count)
+			{
+				outside.push_back(p);
+			}
+		}
+
+		size_t n = fence.boundary_coordinates.size();
+		for (size_t k = 0; k < count && n > 1; k++)
+		{
+			const GPS_Coordinate &a = fence.boundary_coordinates[(k * 7919) % n];
+			const GPS_Coordinate &b = fence.boundary_coordinates[((k * 7919) + 1) % n];
+			float offset = (k % 2) ? 3e-7 : -3e-7;
+			near_boundary.emplace_back((a.latitude + b.latitude) / 2 + offset, (a.longitude + b.longitude) / 2 - offset);
+		}
+	}
+};
+
+/**
+ * @brief Every GeoFence query over one fence and the three point distributions.
+ *
+ * @param fence fence to query
+ * @param points_per_distribution query points in each distribution
+ */
+void benchmark_fence_queries(const GeoFence &fence, size_t points_per_distribution)
+{
+	int vertices = (int)fence.boundary_coordinates.size();
+	printf("\t-- %d vertices, %s\n", vertices, fence.is_convex() ? "convex" : (fence.is_latitude_monotone() ? "monotone" : "not monotone"));
+	BenchmarkPoints points(fence, points_per_distribution);
+	const std::vector<GPS_Coordinate> *sets[] = {&points.inside, &points.outside, &points.near_boundary};
+	const char *names[] = {"inside", "outside", "near"};
+
+	for (int d = 0; d < 3; d++)
+	{
+		const std::vector<GPS_Coordinate> &pts = *sets[d];
+		benchmark_run("is_inside", vertices, names[d], pts.size(), [&](size_t k) { return fence.is_inside(pts[k]); });
+		benchmark_run("distance_to_boundary", vertices, names[d], pts.size(), [&](size_t k) { return fence.distance_to_boundary(pts[k]); });
+		std::vector<GeoFence_Crossing> crossings;
+		benchmark_run("segment_crossings (~150 m segment)", vertices, names[d], pts.size(),
+		              [&](size_t k)
+		              {
+			              GPS_Coordinate to(pts[k].latitude + 0.001f, pts[k].longitude + 0.001f);
+			              return (double)fence.segment_crossings(pts[k], 0, to, 30, false, crossings);
+		              });
+		benchmark_run("boundary_vertice_to_coordinate_distance", vertices, names[d], pts.size(),
+		              [&](size_t k)
+		              {
+			              GPS_Coordinate p = pts[k];
+			              return GeoFence::boundary_vertice_to_coordinate_distance(fence.boundary_coordinates, p);
+		              });
+	}
+}
+
+/**
+ * @brief Point to point distance functions, they don't depend on the fence size.
+ *
+ * @param fence the query points go from the fence vertices to points around it
+ */
+void benchmark_point_distances(const GeoFence &fence)
+{
+	BenchmarkPoints points(fence, 256);
+	const std::vector<GPS_Coordinate> &pts = points.outside;
+	const std::vector<GPS_Coordinate> &vertices = fence.boundary_coordinates;
+	benchmark_run("haversineDistance", 0, "outside", pts.size(),
+	              [&](size_t k) { return GeoFence::haversineDistance(pts[k], vertices[k % vertices.size()]); });
+	benchmark_run("distance_between_coordinates", 0, "outside", pts.size(),
+	              [&](size_t k) { return GeoFence::distance_between_coordinates(pts[k], vertices[k % vertices.size()]); });
+}
+
+/**
+ * @brief Fill a fence with a synthetic star shaped (concave) polygon, used to benchmark fences bigger than the real samples.
+ *
+ * @param fence fence to fill, existing points are kept
+ * @param vertices number of vertices to add
+ * @param center_lat decimal latitude of the center
+ * @param center_lon decimal longitude of the center
+ * @param radius outer radius in decimal degrees, the inner vertices are at 60% of it
+ * @param round all vertices on the outer radius, the fence is then a circle (monotone in latitude, convex before float rounding)
+ */
+void benchmark_make_synthetic_fence(GeoFence &fence, int vertices, float center_lat = -23.21, float center_lon = -45.90,
+                                    float radius = 0.01, bool round = false)
+{
+	for (int k = 0; k < vertices; k++)
+	{
+		double angle = 2 * IMPL_M_PI * k / vertices;
+		double r = (k % 2 || round) ? radius : radius * 0.6;
+		fence.add_point(center_lat + r * sin(angle), center_lon + r * cos(angle));
+	}
+}
+
+/**
+ * @brief Edit latency of insert_point/move_point/remove_point against a full rebuild_index() of the same fence.
+ *
+ * @param vertices fence size
+ */
+void benchmark_fence_editing(int vertices)
+{
+	GeoFence fence;
+	benchmark_make_synthetic_fence(fence, vertices);
+	const int edits = 2000;
+	unsigned int seed = 42;
+	auto next_index = [&seed](size_t n) -> size_t
+	{
+		seed = seed * 1103515245 + 12345;
+		return ((seed >> 8) & 0xFFFFFF) % n;
+	};
+
+	double start = benchmark_now_ns();
+	for (int k = 0; k < edits; k++) fence.move_point(next_index(fence.boundary_coordinates.size()), -23.21 + k * 1e-7, -45.90);
+	double move_ns = (benchmark_now_ns() - start) / edits;
+
+	start = benchmark_now_ns();
+	for (int k = 0; k < edits; k++) fence.insert_point(next_index(fence.boundary_coordinates.size()), -23.21, -45.90 + k * 1e-7);
+	double insert_ns = (benchmark_now_ns() - start) / edits;
+
+	start = benchmark_now_ns();
+	for (int k = 0; k < edits; k++) fence.remove_point(next_index(fence.boundary_coordinates.size()));
+	double remove_ns = (benchmark_now_ns() - start) / edits;
+
+	const int rebuilds = 50;
+	start = benchmark_now_ns();
+	for (int k = 0; k < rebuilds; k++) fence.rebuild_index();
+	double rebuild_ns = (benchmark_now_ns() - start) / rebuilds;
+
+	printf("\t%7d vertices: move %9.0f ns, insert %9.0f ns, remove %9.0f ns, full rebuild %11.0f ns\n", vertices, move_ns, insert_ns,
+	       remove_ns, rebuild_ns);
+}
+
+/**
+ * @brief Import time checks: validate() (sweep line self intersection test) and normalize() on a copy of the fence.
+ *
+ * @param vertices fence size
+ */
+void benchmark_fence_validation(int vertices)
+{
+	GeoFence fence;
+	benchmark_make_synthetic_fence(fence, vertices, -23.21, -45.90, 0.5, true);
+	const int runs = 5;
+	bool valid = true;
+	double start = benchmark_now_ns();
+	for (int k = 0; k < runs; k++) valid = GeoFence_Validator::validate(fence).is_valid() && valid;
+	double validate_ns = (benchmark_now_ns() - start) / runs;
+
+	double normalize_ns = 0;
+	for (int k = 0; k < runs; k++)
+	{
+		GeoFence copy = fence;
+		start = benchmark_now_ns();
+		valid = GeoFence_Validator::normalize(copy).is_valid() && valid;
+		normalize_ns += (benchmark_now_ns() - start) / runs;
+	}
+	printf("\t%7d vertices: validate %9.2f ms, normalize %9.2f ms (%s)\n", vertices, validate_ns / 1e6, normalize_ns / 1e6,
+	       valid ? "valid" : "invalid");
+}
+
+/**
+ * @brief Whether two fences share area the way a relation without any index would find it: every edge of a against every edge of b,
+ * then one vertex of each against the other fence. The baseline for benchmark_fence_overlap().
+ */
+bool benchmark_unpruned_related(const GeoFence &a, const GeoFence &b)
+{
+	const std::vector<GPS_Coordinate> &va = a.boundary_coordinates, &vb = b.boundary_coordinates;
+	auto side = [](const GPS_Coordinate &o, const GPS_Coordinate &p, const GPS_Coordinate &q)
+	{
+		double c = ((double)p.longitude - o.longitude) * ((double)q.latitude - o.latitude) -
+		           ((double)p.latitude - o.latitude) * ((double)q.longitude - o.longitude);
+		return (c > 0) - (c < 0);
+	};
+	for (size_t i = 0; i < va.size(); i++)
+	{
+		const GPS_Coordinate &p0 = va[i], &p1 = va[(i + 1) % va.size()];
+		for (size_t j = 0; j < vb.size(); j++)
+		{
+			const GPS_Coordinate &q0 = vb[j], &q1 = vb[(j + 1) % vb.size()];
+			if (side(p0, p1, q0) * side(p0, p1, q1) < 0 && side(q0, q1, p0) * side(q0, q1, p1) < 0) return true;
+		}
+	}
+	return b.is_inside(va[0]) || a.is_inside(vb[0]);
+}
+
+/**
+ * @brief Related pairs of a set of fences scattered over a 4 degree square. The pair search alone (bounding box sweep against testing
+ * the boxes of all N^2 pairs) and the whole find_related_pairs() against relating all pairs edge by edge without any pruning.
+ *
+ * @param fence_count fences in the set
+ * @param vertices vertices of each fence in the set
+ * @param unpruned also time the unpruned relation, N^2 * vertices^2 edge tests
+ */
+void benchmark_fence_overlap(int fence_count, int vertices, bool unpruned)
+{
+	DifferentialRandom rng(99);
+	std::vector<GeoFence> fences(fence_count);
+	for (GeoFence &fence : fences)
+		benchmark_make_synthetic_fence(fence, vertices, -25.0 + 4 * rng.uniform(), -48.0 + 4 * rng.uniform(), 0.02 + rng.uniform() * 0.08);
+
+	size_t candidates = 0;
+	double start = benchmark_now_ns();
+	GeoFence_Overlap::sweep_fence_boxes(fences, [&candidates](size_t, size_t) { candidates++; });
+	double sweep_ns = benchmark_now_ns() - start;
+
+	size_t box_pairs = 0;
+	start = benchmark_now_ns();
+	for (size_t i = 0; i < fences.size(); i++)
+	{
+		for (size_t j = i + 1; j < fences.size(); j++) box_pairs += fences[i].bounding_box().overlaps(fences[j].bounding_box());
+	}
+	double all_boxes_ns = benchmark_now_ns() - start;
+	size_t all_pairs = fences.size() * (fences.size() - 1) / 2;
+	printf("\t%5d fences x %5d vertices: pair search %u of %u pairs, sweep %9.3f ms, all boxes %9.3f ms (%u)\n", fence_count, vertices,
+	       (unsigned)candidates, (unsigned)all_pairs, sweep_ns / 1e6, all_boxes_ns / 1e6, (unsigned)box_pairs);
+
+	std::vector<GeoFence_PairRelation> pairs;
+	start = benchmark_now_ns();
+	GeoFence_Overlap::find_related_pairs(fences, pairs);
+	double related_ns = benchmark_now_ns() - start;
+	if (!unpruned)
+	{
+		printf("\t%5d fences x %5d vertices: %u related pairs, find_related_pairs %9.2f ms\n", fence_count, vertices, (unsigned)pairs.size(),
+		       related_ns / 1e6);
+		return;
+	}
+	size_t related = 0;
+	start = benchmark_now_ns();
+	for (size_t i = 0; i < fences.size(); i++)
+	{
+		for (size_t j = i + 1; j < fences.size(); j++) related += benchmark_unpruned_related(fences[i], fences[j]);
+	}
+	double unpruned_ns = benchmark_now_ns() - start;
+	printf("\t%5d fences x %5d vertices: %u related pairs, find_related_pairs %9.2f ms, unpruned %9.2f ms (%u related, %.0fx)\n",
+	       fence_count, vertices, (unsigned)pairs.size(), related_ns / 1e6, unpruned_ns / 1e6, (unsigned)related, unpruned_ns / related_ns);
+}
+
+/**
+ * @brief Shared area of a round fence and an overlapping star whose edges all run across the round boundary, and the cheaper test
+ * whether the boundaries touch at all.
+ *
+ * @param vertices vertices of each fence
+ */
+void benchmark_overlap_area(int vertices)
+{
+	GeoFence a, b;
+	benchmark_make_synthetic_fence(a, vertices, -23.21, -45.90, 0.5, true);
+	benchmark_make_synthetic_fence(b, vertices, -23.01, -45.60, 0.5);
+	const int runs = 5;
+	double area = 0;
+	double start = benchmark_now_ns();
+	for (int k = 0; k < runs; k++) area = GeoFence_Overlap::overlap_area_degrees(a, b);
+	double area_ns = (benchmark_now_ns() - start) / runs;
+	start = benchmark_now_ns();
+	bool touch = false;
+	for (int k = 0; k < runs; k++) touch = GeoFence_Overlap::boundaries_touch(a, b) || touch;
+	double touch_ns = (benchmark_now_ns() - start) / runs;
+	printf("\t%7d vertices each: overlap area %9.2f ms (%.6f deg2), boundaries touch %9.3f ms (%s)\n", vertices, area_ns / 1e6, area,
+	       touch_ns / 1e6, touch ? "true" : "false");
+}
+
+/**
+ * @brief Value at a given percentile (0-100), sorts the samples.
+ */
+double benchmark_percentile(std::vector<double> &samples, double percentile)
+{
+	if (samples.empty()) return 0;
+	std::sort(samples.begin(), samples.end());
+	size_t index = (size_t)(percentile / 100.0 * (samples.size() - 1));
+	return samples[index];
+}
+
+#if defined(ESP32) || defined(_WIN32) || defined(__linux__)
+/**
+ * @brief Recorded NMEA log (RMC, GGA and GSV every second, like a typical receiver) parsed straight into fix batches, alone and with
+ * the batches evaluated against a few fences, in MB of log per second.
+ *
+ * @param kilobytes size of the log
+ */
+void benchmark_gnss_ingest(int kilobytes)
+{
+	DifferentialRandom rng(35);
+	std::vector<uint8_t> log;
+	log.reserve((size_t)kilobytes << 10);
+	for (uint32_t second = 0; log.size() < ((size_t)kilobytes << 10); second++)
+	{
+		double lat = -23.215 + rng.uniform() * 0.01, lon = -45.912 + rng.uniform() * 0.012;
+		uint32_t time_ms = second % 86400 * 1000;
+		test_append_fix_sentence(log, true, lat, lon, rng.uniform() * 40, time_ms);
+		test_append_fix_sentence(log, false, lat, lon, 0, time_ms);
+		test_append_nmea(log, "GPGSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00");
+	}
+
+	std::vector<GeoFence> fences(4);
+	load_fence_simova_4points(fences[0]);
+	load_fence_99points(fences[1]);
+	benchmark_make_synthetic_fence(fences[2], 450, -23.21, -45.90, 0.005);
+	benchmark_make_synthetic_fence(fences[3], 450, -23.20, -45.91, 0.004, true);
+
+	for (int evaluate = 0; evaluate < 2; evaluate++)
+	{
+		GeoFence_GnssParser parser(GEOFENCE_FIX_NMEA_RMC);
+		GeoFence_FixBatch batch;
+		size_t inside = 0;
+		double start = benchmark_now_ns();
+		for (size_t offset = 0; offset < log.size();)
+		{
+			offset += parser.parse(log.data() + offset, log.size() - offset, batch);
+			if (evaluate) inside += batch.evaluate(fences);
+			batch.clear();
+		}
+		double ns = benchmark_now_ns() - start;
+		printf("\t%7d kB log, %s: %8.1f MB/s, %u fixes (%u inside), %u checksum errors\n", kilobytes,
+		       evaluate ? "parse + evaluate 4 fences" : "parse only              ", log.size() / 1048576.0 / (ns / 1e9),
+		       parser.counters.fixes, (unsigned)inside, parser.counters.checksum_errors);
+	}
+}
+
+/**
+ * @brief GeoFence_DeviceStore with many devices moving a few meters per fix across a city with 64 fences: the first round that
+ * evaluates every device, then steady rounds where only devices that left their clearance run is_inside(), against testing every
+ * fix with every fence.
+ *
+ * @param devices number of tracked devices
+ */
+void benchmark_device_store(int devices)
+{
+	DifferentialRandom rng(36);
+	std::vector<GeoFence> fences(64);
+	for (GeoFence &fence : fences)
+		benchmark_make_synthetic_fence(fence, 8 + rng.below(200), -23.45 + rng.uniform() * 0.5, -46.15 + rng.uniform() * 0.5,
+		                               0.002 + rng.uniform() * 0.02, rng.below(2));
+
+	std::vector<uint64_t> ids(devices);
+	std::vector<GeoFence_Fix> fixes(devices);
+	for (int d = 0; d < devices; d++)
+	{
+		ids[d] = 1000000000ULL + d * 7919ULL;
+		fixes[d].latitude = (float)(-23.45 + rng.uniform() * 0.5);
+		fixes[d].longitude = (float)(-46.15 + rng.uniform() * 0.5);
+		fixes[d].unix_time_ms = 1773792000000ULL;
+	}
+
+	GeoFence_DeviceStore store(fences);
+	double start = benchmark_now_ns();
+	store.update(ids.data(), fixes.data(), devices);
+	double first_ns = benchmark_now_ns() - start;
+
+	const int rounds = 5;
+	double steady_ns = 0;
+	for (int round = 1; round <= rounds; round++)
+	{
+		for (GeoFence_Fix &fix : fixes)
+		{
+			fix.latitude += (float)((rng.uniform() - 0.5) * 0.0002);    // up to ~10 m
+			fix.longitude += (float)((rng.uniform() - 0.5) * 0.0002);
+			fix.unix_time_ms = 1773792000000ULL + round * 1000;
+		}
+		start = benchmark_now_ns();
+		store.update(ids.data(), fixes.data(), devices);
+		steady_ns += benchmark_now_ns() - start;
+	}
+
+	size_t inside = 0;
+	start = benchmark_now_ns();
+	for (const GeoFence_Fix &fix : fixes)
+	{
+		for (const GeoFence &fence : fences) inside += fence.is_inside(fix.coordinate());
+	}
+	double all_fences_ns = benchmark_now_ns() - start;
+	benchmark_sink = inside;
+
+	double skipped = (double)store.skipped / (store.skipped + store.evaluations - devices);
+	printf("\t%8d devices x %d fences: %.1f bytes/device, first round %8.1f ns/fix, steady %6.1f ns/fix (%.1f%% skipped), every "
+	       "fence %6.1f ns/fix\n",
+	       devices, (int)fences.size(), (double)store.memory_bytes() / devices, first_ns / devices, steady_ns / rounds / devices,
+	       100 * skipped, all_fences_ns / devices);
+}
+#endif
+
+/**
+ * @brief Distances from every vehicle to every depot: the scalar distance_between_coordinates() loop, GeoFence_DistanceMatrix::compute()
+ * in bands of rows and the 5 nearest depots per vehicle.
+ *
+ * @param vehicles rows of the matrix
+ * @param depots columns of the matrix
+ */
+void benchmark_distance_matrix(int vehicles, int depots)
+{
+	DifferentialRandom rng(37);
+	std::vector<GPS_Coordinate> vehicle_points, depot_points;
+	for (int k = 0; k < vehicles; k++) vehicle_points.emplace_back((float)(-24 + rng.uniform() * 2), (float)(-47 + rng.uniform() * 2));
+	for (int k = 0; k < depots; k++) depot_points.emplace_back((float)(-24 + rng.uniform() * 2), (float)(-47 + rng.uniform() * 2));
+
+	double sum = 0;
+	double start = benchmark_now_ns();
+	for (const GPS_Coordinate &v : vehicle_points)
+	{
+		for (const GPS_Coordinate &d : depot_points) sum += GeoFence::distance_between_coordinates(v, d);
+	}
+	double scalar_ns = benchmark_now_ns() - start;
+
+	start = benchmark_now_ns();
+	GeoFence_PointTable rows(vehicle_points), cols(depot_points);
+	const size_t band = 64;
+	std::vector<float> matrix(band * depots);
+	for (size_t r = 0; r < rows.size(); r += band)
+	{
+		size_t count = std::min(band, rows.size() - r);
+		GeoFence_DistanceMatrix::compute(rows, r, count, cols, matrix.data());
+		sum += matrix[0];
+	}
+	double matrix_ns = benchmark_now_ns() - start;
+
+	start = benchmark_now_ns();
+	std::vector<GeoFence_Neighbor> nearest;
+	GeoFence_DistanceMatrix::nearest(rows, cols, 5, nearest);
+	double nearest_ns = benchmark_now_ns() - start;
+	benchmark_sink = sum + nearest[0].distance_m;
+
+	double pairs = (double)vehicles * depots;
+	printf("\t%6d x %5d: scalar loop %8.2f ms (%5.1f ns/pair), matrix %8.2f ms (%4.1f ns/pair, %4.1fx), 5 nearest %8.2f ms (%5.1fx)\n",
+	       vehicles, depots, scalar_ns / 1e6, scalar_ns / pairs, matrix_ns / 1e6, matrix_ns / pairs, scalar_ns / matrix_ns, nearest_ns / 1e6,
+	       scalar_ns / nearest_ns);
+}
+
+/**
+ * @brief Spherical against WGS84 distances on the benchmark points of a fence: time per query and error against the Vincenty
+ * reference (test_wgs84_reference_distance()), and the same for point to point distances.
+ *
+ * @param fence fence to measure
+ */
+void benchmark_wgs84_distance(const GeoFence &fence)
+{
+	int vertices = (int)fence.boundary_coordinates.size();
+	BenchmarkPoints points(fence, 64);
+	std::vector<GPS_Coordinate> pts = points.inside;
+	pts.insert(pts.end(), points.outside.begin(), points.outside.end());
+	pts.insert(pts.end(), points.near_boundary.begin(), points.near_boundary.end());
+
+	double start = benchmark_now_ns();
+	GeoFence_Wgs84Fence wgs84(fence);
+	double build_ns = benchmark_now_ns() - start;
+	printf("\t-- %d vertices, GeoFence_Wgs84Fence built in %.1f us\n", vertices, build_ns / 1e3);
+	benchmark_run("distance_to_boundary (sphere)", vertices, "all", pts.size(), [&](size_t k) { return fence.distance_to_boundary(pts[k]); });
+	benchmark_run("GeoFence_Wgs84Fence::distance_to_boundary", vertices, "all", pts.size(),
+	              [&](size_t k) { return wgs84.distance_to_boundary(pts[k]); });
+	const std::vector<GPS_Coordinate> &v = fence.boundary_coordinates;
+	benchmark_run("distance_between_coordinates (sphere)", 0, "all", pts.size(),
+	              [&](size_t k) { return GeoFence::distance_between_coordinates(pts[k], v[k % v.size()]); });
+	benchmark_run("GeoFence_Wgs84::vincenty_distance", 0, "all", pts.size(),
+	              [&](size_t k) { return GeoFence_Wgs84::vincenty_distance(pts[k], v[k % v.size()]); });
+
+	double sphere_worst = 0, sphere_sum = 0, wgs84_worst = 0, wgs84_sum = 0, pair_worst = 0;
+	for (size_t k = 0; k < pts.size(); k++)
+	{
+		double reference = test_wgs84_reference_distance(fence, pts[k]);
+		double sphere_error = fabs(fence.distance_to_boundary(pts[k]) - reference);
+		double wgs84_error = fabs(wgs84.distance_to_boundary(pts[k]) - reference);
+		sphere_worst = std::max(sphere_worst, sphere_error);
+		sphere_sum += sphere_error;
+		wgs84_worst = std::max(wgs84_worst, wgs84_error);
+		wgs84_sum += wgs84_error;
+		double pair = GeoFence_Wgs84::vincenty_distance(pts[k], v[k % v.size()]);
+		double sphere_pair = GeoFence::distance_between_coordinates(pts[k], v[k % v.size()]);
+		if (pair > 0) pair_worst = std::max(pair_worst, fabs(sphere_pair - pair) / pair);
+	}
+	printf("\terror against Vincenty: sphere worst %.3f m mean %.3f m, wgs84 worst %.4f m mean %.4f m, point to point sphere %.2f%%\n",
+	       sphere_worst, sphere_sum / pts.size(), wgs84_worst, wgs84_sum / pts.size(), pair_worst * 100);
+}
+
+#if defined(ESP32) || defined(_WIN32) || defined(__linux__)
+/**
+ * @brief Time spent on the producer (GPS/modem) task per fix: running is_inside() and distance_to_boundary() inline against posting
+ * the fix to a GeoFence_AsyncEvaluator on the other core, and how long the worker takes to answer all of them.
+ *
+ * @param vertices vertices of the large fence next to the norway sample
+ * @param fixes number of fixes
+ */
+void benchmark_async_offload(int vertices, int fixes)
+{
+	std::vector<GeoFence> fences(2);
+	load_fence_norway_450points(fences[0]);
+	benchmark_make_synthetic_fence(fences[1], vertices, -23.21, -45.90, 0.05, true);
+	DifferentialRandom rng(38);
+	std::vector<GeoFence_AsyncQuery> queries(fixes);
+	for (int k = 0; k < fixes; k++)
+	{
+		queries[k].tag = k;
+		queries[k].flags = GEOFENCE_ASYNC_INSIDE | GEOFENCE_ASYNC_DISTANCE;
+		queries[k].fix.latitude = (float)(-23.26 + rng.uniform() * 0.1);
+		queries[k].fix.longitude = (float)(-45.95 + rng.uniform() * 0.1);
+	}
+
+	std::vector<double> inline_ns, post_ns;
+	double sum = 0;
+	for (const GeoFence_AsyncQuery &q : queries)
+	{
+		double start = benchmark_now_ns();
+		for (const GeoFence &fence : fences) sum += fence.is_inside(q.fix.coordinate()) + fence.distance_to_boundary(q.fix.coordinate());
+		inline_ns.push_back(benchmark_now_ns() - start);
+	}
+
+	GeoFence_AsyncEvaluator evaluator(fences);
+	evaluator.start(1);
+	GeoFence_AsyncQuery result;
+	int received = 0;
+	double start_all = benchmark_now_ns();
+	for (const GeoFence_AsyncQuery &q : queries)
+	{
+		double start = benchmark_now_ns();
+		bool accepted = evaluator.post(q);
+		post_ns.push_back(benchmark_now_ns() - start);
+		while (!accepted)    // the producer would drop or keep the fix for later, here it waits so every fix is answered
+		{
+			while (evaluator.poll(result)) received++;
+			accepted = evaluator.post(q);
+		}
+		while (evaluator.poll(result)) received++;
+	}
+	while (received < fixes)
+	{
+		if (evaluator.poll(result)) received++;
+	}
+	double all_ns = benchmark_now_ns() - start_all;
+	evaluator.stop();
+	benchmark_sink = sum;
+
+	// on a PC only the posts that find the worker asleep release its semaphore, those are the tail
+	printf("\t%6d vertices: inline p50 %8.0f ns p99 %8.0f ns max %8.0f ns | post p50 %5.0f ns p99 %5.0f ns max %8.0f ns, %.1f%% woke the "
+	       "worker | worker %6.0f ns/fix\n",
+	       vertices, benchmark_percentile(inline_ns, 50), benchmark_percentile(inline_ns, 99), benchmark_percentile(inline_ns, 100),
+	       benchmark_percentile(post_ns, 50), benchmark_percentile(post_ns, 99), benchmark_percentile(post_ns, 100),
+	       100.0 * evaluator.wakeups / evaluator.posted, all_ns / fixes);
+}
+#endif
+
+#if defined(_WIN32) || defined(__linux__)
+/**
+ * @brief Query latency of readers on a GeoFence_SnapshotStore, first with a stable set and then while a writer thread publishes a new
+ * set at a fixed rate. The writer copies a prebuilt set for every reload, so the rate doesn't depend on how long building takes.
+ *
+ * @param fence_count fences in the set
+ * @param vertices vertices of each fence
+ * @param reader_threads number of querying threads
+ * @param reloads_per_second publish rate of the writer
+ * @param seconds length of each phase
+ */
+void benchmark_snapshot_reload(int fence_count, int vertices, int reader_threads, int reloads_per_second, int seconds)
+{
+	GeoFence_Set prebuilt;
+	prebuilt.fences.resize(fence_count);
+	for (int f = 0; f < fence_count; f++) benchmark_make_synthetic_fence(prebuilt.fences[f], vertices, -23.21 + f * 0.03, -45.90, 0.01);
+
+	for (int phase = 0; phase < 2; phase++)
+	{
+		bool reloading = (phase == 1);
+		GeoFence_SnapshotStore store;
+		store.publish(new GeoFence_Set(prebuilt));
+		std::atomic<bool> stop(false);
+		std::atomic<int> reloads(0);
+		std::vector<std::vector<double>> latencies(reader_threads);
+
+		std::vector<std::thread> readers;
+		for (int t = 0; t < reader_threads; t++)
+		{
+			latencies[t].reserve(1 << 22);    // growing the vector while timing would show up as latency spikes
+			readers.emplace_back(
+			    [&, t]()
+			    {
+				    GeoFence_SnapshotReader reader(store);
+				    int k = 0;
+				    while (!stop.load() && latencies[t].size() < latencies[t].capacity())
+				    {
+					    GPS_Coordinate p(-23.22 + (k % 97) * 0.0004, -45.91 + (k % 89) * 0.0002);
+					    double start = benchmark_now_ns();
+					    {
+						    GeoFence_ReadGuard guard(reader);
+						    guard->first_containing(p);
+					    }
+					    latencies[t].push_back(benchmark_now_ns() - start);
+					    k++;
+				    }
+			    });
+		}
+
+		std::thread writer;
+		double publish_ns = 0;
+		if (reloading)
+		{
+			writer = std::thread(
+			    [&]()
+			    {
+				    auto period = std::chrono::microseconds(1000000 / reloads_per_second);
+				    auto next = std::chrono::steady_clock::now();
+				    while (!stop.load())
+				    {
+					    GeoFence_Set *set = new GeoFence_Set(prebuilt);
+					    double start = benchmark_now_ns();
+					    store.publish(set);
+					    publish_ns += benchmark_now_ns() - start;
+					    reloads++;
+					    next += period;
+					    std::this_thread::sleep_until(next);    // fixed rate, the readers get the cores in between
+				    }
+			    });
+		}
+
+		std::this_thread::sleep_for(std::chrono::seconds(seconds));
+		stop.store(true);
+		for (auto &t : readers) t.join();
+		if (writer.joinable()) writer.join();
+
+		std::vector<double> all;
+		for (auto &l : latencies) all.insert(all.end(), l.begin(), l.end());
+		double p50 = benchmark_percentile(all, 50);
+		double p99 = benchmark_percentile(all, 99);
+		double p999 = benchmark_percentile(all, 99.9);
+		printf("\t%s: %d fences x %d vertices, %d readers, %d reloads (%.0f/s, publish %.0f us), %d queries, p50 %.0f ns, p99 %.0f ns, "
+		       "p99.9 %.0f ns, max %.0f ns\n",
+		       reloading ? "reload loop" : "stable set ", fence_count, vertices, reader_threads, reloads.load(), (double)reloads.load() / seconds,
+		       reloads.load() ? publish_ns / reloads.load() / 1000 : 0, (int)all.size(), p50, p99, p999, all.empty() ? 0 : all.back());
+	}
+}
+#endif
+
+/**
+ * @brief Run every benchmark and print the results.
+ */
+void benchmark_geofence()
+{
+	printf("benchmark_fence_queries()\n");
+	{
+		GeoFence fence;
+		load_fence_simova_4points(fence);
+		benchmark_point_distances(fence);
+		benchmark_fence_queries(fence, 256);
+	}
+	{
+		GeoFence fence;
+		load_fence_99points(fence);
+		benchmark_fence_queries(fence, 256);
+	}
+	{
+		GeoFence fence;
+		load_fence_norway_450points(fence);
+		benchmark_fence_queries(fence, 256);
+	}
+	{
+		GeoFence fence;
+		benchmark_make_synthetic_fence(fence, 10000);
+		benchmark_fence_queries(fence, 64);
+	}
+	{
+		GeoFence fence;
+		benchmark_make_synthetic_fence(fence, 10000, -23.21, -45.90, 0.5, true);
+		benchmark_fence_queries(fence, 64);
+	}
+#if !defined(ESP32) && !defined(ARDUINO)    // 100k vertices don't fit in the esp32 heap
+	{
+		GeoFence fence;
+		benchmark_make_synthetic_fence(fence, 100000);
+		benchmark_fence_queries(fence, 16);
+	}
+	{
+		GeoFence fence;
+		benchmark_make_synthetic_fence(fence, 100000, -23.21, -45.90, 0.5, true);
+		benchmark_fence_queries(fence, 16);
+	}
+#endif
+
+	printf("benchmark_fence_editing()\n");
+	benchmark_fence_editing(450);
+	benchmark_fence_editing(10000);
+#if !defined(ESP32) && !defined(ARDUINO)
+	benchmark_fence_editing(100000);
+#endif
+
+	printf("benchmark_fence_validation()\n");
+	benchmark_fence_validation(450);
+	benchmark_fence_validation(10000);
+#if !defined(ESP32) && !defined(ARDUINO)
+	benchmark_fence_validation(100000);
+#endif
+
+	printf("benchmark_fence_overlap()\n");
+	benchmark_fence_overlap(100, 64, true);
+	benchmark_fence_overlap(500, 64, false);
+	benchmark_overlap_area(1000);
+	benchmark_overlap_area(10000);
+#if !defined(ESP32) && !defined(ARDUINO)
+	benchmark_fence_overlap(300, 64, true);
+	benchmark_fence_overlap(2000, 64, false);
+	benchmark_overlap_area(100000);
+#endif
+
+#if defined(ESP32) || defined(_WIN32) || defined(__linux__)
+	printf("benchmark_gnss_ingest()\n");
+	benchmark_gnss_ingest(96);    // fits the esp32 heap
+#if !defined(ESP32) && !defined(ARDUINO)
+	benchmark_gnss_ingest(256 * 1024);
+#endif
+
+	printf("benchmark_device_store()\n");
+	benchmark_device_store(10000);
+#if !defined(ESP32) && !defined(ARDUINO)
+	benchmark_device_store(2000000);
+#endif
+#endif
+
+	printf("benchmark_distance_matrix()\n");
+	benchmark_distance_matrix(200, 100);
+#if !defined(ESP32) && !defined(ARDUINO)
+	benchmark_distance_matrix(10000, 5000);
+#endif
+
+	printf("benchmark_wgs84_distance()\n");
+	{
+		GeoFence fence;
+		load_fence_simova_4points(fence);
+		benchmark_wgs84_distance(fence);
+	}
+	{
+		GeoFence fence;
+		load_fence_norway_450points(fence);
+		benchmark_wgs84_distance(fence);
+	}
+	{
+		GeoFence fence;
+		benchmark_make_synthetic_fence(fence, 10000, -23.21, -45.90, 0.01);
+		benchmark_wgs84_distance(fence);
+	}
+
+#if defined(ESP32) || defined(_WIN32) || defined(__linux__)
+	printf("benchmark_async_offload()\n");
+	benchmark_async_offload(1000, 2000);
+	benchmark_async_offload(10000, 2000);
+#endif
+
+#if defined(_WIN32) || defined(__linux__)
+	printf("benchmark_snapshot_reload()\n");
+	benchmark_snapshot_reload(8, 10000, 3, 200, 2);
+#endif
+}
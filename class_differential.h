@@ -0,0 +1,361 @@
+/**
+ * @file class_differential.h
+ * @author Italo Soares (italocjs@live.com)
+ * @brief Differential tests, random fences and query points are checked against a copy of the original full scan algorithms so any
+ * accelerated query path can be trusted. Run a long campaign with "myfile.exe --diff 100000", the fuzz/ folder has a libFuzzer entry.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+#include "geofence.h"
+#include <cstdint>
+
+/**
+ * @brief Original ray cast over every edge, kept as the reference for GeoFence::is_inside().
+ */
+bool reference_is_inside(const std::vector<GPS_Coordinate> &boundary, const GPS_Coordinate &p)
+{
+	int numVertices = boundary.size();
+	int j = numVertices - 1;
+	bool inside = false;
+	for (int i = 0; i < numVertices; i++)
+	{
+		if ((boundary[i].latitude < p.latitude && boundary[j].latitude >= p.latitude) ||
+		    (boundary[j].latitude < p.latitude && boundary[i].latitude >= p.latitude))
+		{
+			if (boundary[i].longitude + (p.latitude - boundary[i].latitude) / (boundary[j].latitude - boundary[i].latitude) *
+			                                (boundary[j].longitude - boundary[i].longitude) <
+			    p.longitude)
+			{
+				inside = !inside;
+			}
+		}
+		j = i;
+	}
+	return inside;
+}
+
+/**
+ * @brief Original distance to the nearest edge over every edge, kept as the reference for GeoFence::distance_to_boundary().
+ */
+double reference_distance_to_boundary(const std::vector<GPS_Coordinate> &boundary, const GPS_Coordinate &p)
+{
+	double min_distance = std::numeric_limits<double>::max();
+	int numVertices = boundary.size();
+	for (int i = 0; i < numVertices; i++)
+	{
+		double distance = GeoFence::calculate_distance_to_segment(boundary[i], boundary[(i + 1) % numVertices], p);
+		if (distance < min_distance) min_distance = distance;
+	}
+	return min_distance;
+}
+
+int reference_orientation(const GPS_Coordinate &a, const GPS_Coordinate &b, const GPS_Coordinate &c)
+{
+	double cross = ((double)b.longitude - a.longitude) * ((double)c.latitude - a.latitude) -
+	               ((double)b.latitude - a.latitude) * ((double)c.longitude - a.longitude);
+	return (cross > 0) - (cross < 0);
+}
+
+bool reference_on_segment(const GPS_Coordinate &a, const GPS_Coordinate &b, const GPS_Coordinate &p)
+{
+	return std::min(a.longitude, b.longitude) <= p.longitude && p.longitude <= std::max(a.longitude, b.longitude) &&
+	       std::min(a.latitude, b.latitude) <= p.latitude && p.latitude <= std::max(a.latitude, b.latitude);
+}
+
+/**
+ * @brief Every pair of edges, O(n^2), kept as the reference for GeoFence_Validator::find_self_intersection(). Expects no consecutive
+ * copies of a vertex, neighbouring edges only count when the boundary goes back along the edge it came from.
+ */
+bool reference_self_intersection(const std::vector<GPS_Coordinate> &boundary)
+{
+	size_t n = boundary.size();
+	if (n < 4) return false;
+	for (size_t k = 0; k < n; k++)
+	{
+		const GPS_Coordinate &before = boundary[(k + n - 1) % n], &vertex = boundary[k], &after = boundary[(k + 1) % n];
+		double dot = ((double)before.longitude - vertex.longitude) * ((double)after.longitude - vertex.longitude) +
+		             ((double)before.latitude - vertex.latitude) * ((double)after.latitude - vertex.latitude);
+		if (reference_orientation(vertex, before, after) == 0 && dot > 0) return true;
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		for (size_t j = i + 2; j < n; j++)
+		{
+			if (i == 0 && j == n - 1) continue;
+			const GPS_Coordinate &p1 = boundary[i], &p2 = boundary[(i + 1) % n], &q1 = boundary[j], &q2 = boundary[(j + 1) % n];
+			int d1 = reference_orientation(q1, q2, p1), d2 = reference_orientation(q1, q2, p2);
+			int d3 = reference_orientation(p1, p2, q1), d4 = reference_orientation(p1, p2, q2);
+			if (d1 * d2 < 0 && d3 * d4 < 0) return true;
+			if ((d1 == 0 && reference_on_segment(q1, q2, p1)) || (d2 == 0 && reference_on_segment(q1, q2, p2)) ||
+			    (d3 == 0 && reference_on_segment(p1, p2, q1)) || (d4 == 0 && reference_on_segment(p1, p2, q2)))
+				return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Area shared by any simple polygon and a convex one, in square degrees, by clipping the first with every edge of the second
+ * (Sutherland-Hodgman). Kept as the reference for GeoFence_Overlap::overlap_area_degrees().
+ */
+double reference_convex_overlap_area(const std::vector<GPS_Coordinate> &subject, const std::vector<GPS_Coordinate> &convex)
+{
+	std::vector<double> xs, ys;
+	for (const GPS_Coordinate &c : subject)
+	{
+		xs.push_back(c.longitude);
+		ys.push_back(c.latitude);
+	}
+	double clip_area = 0;
+	size_t m = convex.size();
+	for (size_t k = 0; k < m; k++)
+		clip_area += (double)convex[k].longitude * convex[(k + 1) % m].latitude - (double)convex[(k + 1) % m].longitude * convex[k].latitude;
+	double side = clip_area < 0 ? -1 : 1;
+
+	for (size_t k = 0; k < m && !xs.empty(); k++)
+	{
+		double ax = convex[k].longitude, ay = convex[k].latitude;
+		double bx = convex[(k + 1) % m].longitude, by = convex[(k + 1) % m].latitude;
+		auto inside = [&](double x, double y) { return side * ((bx - ax) * (y - ay) - (by - ay) * (x - ax)) >= 0; };
+		std::vector<double> next_xs, next_ys;
+		for (size_t i = 0; i < xs.size(); i++)
+		{
+			size_t j = (i + 1) % xs.size();
+			bool in_i = inside(xs[i], ys[i]), in_j = inside(xs[j], ys[j]);
+			if (in_i)
+			{
+				next_xs.push_back(xs[i]);
+				next_ys.push_back(ys[i]);
+			}
+			if (in_i != in_j)
+			{
+				double di = (bx - ax) * (ys[i] - ay) - (by - ay) * (xs[i] - ax);
+				double dj = (bx - ax) * (ys[j] - ay) - (by - ay) * (xs[j] - ax);
+				double t = di / (di - dj);
+				next_xs.push_back(xs[i] + t * (xs[j] - xs[i]));
+				next_ys.push_back(ys[i] + t * (ys[j] - ys[i]));
+			}
+		}
+		xs.swap(next_xs);
+		ys.swap(next_ys);
+	}
+	double twice_area = 0;
+	for (size_t i = 0; i < xs.size(); i++)
+	{
+		size_t j = (i + 1) % xs.size();
+		twice_area += (xs[i] - xs[0]) * (ys[j] - ys[0]) - (xs[j] - xs[0]) * (ys[i] - ys[0]);
+	}
+	return fabs(twice_area) / 2;
+}
+
+/**
+ * @brief Small deterministic random generator (xorshift32), the same seed gives the same fences on every platform.
+ */
+class DifferentialRandom
+{
+   private:
+	uint32_t state;
+
+   public:
+	DifferentialRandom(uint32_t seed) : state(seed ? seed : 0x9E3779B9) {}
+
+	uint32_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	double uniform() { return (next() >> 8) / 16777216.0; }    // [0, 1)
+	int below(int n) { return (int)(uniform() * n); }
+};
+
+/**
+ * @brief Random simple polygon: vertices at sorted random angles around a center with random radii (star shaped, so it never self
+ * intersects and is concave most of the time). With snap_to_grid the vertices are rounded to a coarse grid, which gives horizontal
+ * edges, collinear and repeated vertices, the cases where the ray cast is most fragile.
+ *
+ * @param fence fence to fill, must be empty
+ * @param rng random generator
+ * @param vertices number of vertices (at least 3)
+ * @param snap_to_grid round the vertices to a 1e-4 degree grid
+ */
+void differential_random_polygon(GeoFence &fence, DifferentialRandom &rng, int vertices, bool snap_to_grid)
+{
+	double center_lat = -60 + rng.uniform() * 120;
+	double center_lon = -170 + rng.uniform() * 340;
+	double radius = 0.001 + rng.uniform() * 0.05;
+	std::vector<double> angles(vertices);
+	for (auto &a : angles) a = rng.uniform() * 2 * IMPL_M_PI;
+	std::sort(angles.begin(), angles.end());
+
+	for (int k = 0; k < vertices; k++)
+	{
+		double r = radius * (0.2 + 0.8 * rng.uniform());
+		double lat = center_lat + r * sin(angles[k]);
+		double lon = center_lon + r * cos(angles[k]);
+		if (snap_to_grid)
+		{
+			lat = round(lat * 1e4) / 1e4;
+			lon = round(lon * 1e4) / 1e4;
+		}
+		fence.add_point(lat, lon);
+	}
+}
+
+/**
+ * @brief Random convex polygon: vertices at sorted random angles on an ellipse, exercises the monotone chain path of is_inside().
+ *
+ * @param fence fence to fill, must be empty
+ * @param rng random generator
+ * @param vertices number of vertices (at least 3)
+ */
+void differential_random_convex_polygon(GeoFence &fence, DifferentialRandom &rng, int vertices)
+{
+	double center_lat = -60 + rng.uniform() * 120;
+	double center_lon = -170 + rng.uniform() * 340;
+	double radius_lat = 0.001 + rng.uniform() * 0.05;
+	double radius_lon = 0.001 + rng.uniform() * 0.05;
+	std::vector<double> angles(vertices);
+	for (auto &a : angles) a = rng.uniform() * 2 * IMPL_M_PI;
+	std::sort(angles.begin(), angles.end());
+	for (int k = 0; k < vertices; k++) fence.add_point(center_lat + radius_lat * sin(angles[k]), center_lon + radius_lon * cos(angles[k]));
+}
+
+/**
+ * @brief Query points for a fence: random points around it, points exactly on vertices, points on edges and points on the latitude of a
+ * vertex (the ray then passes through that vertex).
+ */
+std::vector<GPS_Coordinate> differential_query_points(const GeoFence &fence, DifferentialRandom &rng, int count)
+{
+	std::vector<GPS_Coordinate> points;
+	const std::vector<GPS_Coordinate> &v = fence.boundary_coordinates;
+	if (v.empty()) return points;
+	const GeoFence_BoundingBox &box = fence.bounding_box();
+	float lat_span = box.max_latitude - box.min_latitude;
+	float lon_span = box.max_longitude - box.min_longitude;
+
+	for (int k = 0; k < count; k++)
+	{
+		const GPS_Coordinate &a = v[rng.below(v.size())];
+		const GPS_Coordinate &b = v[rng.below(v.size())];
+		switch (k % 4)
+		{
+			case 0:
+				points.emplace_back(box.min_latitude + (rng.uniform() * 1.4 - 0.2) * lat_span,
+				                    box.min_longitude + (rng.uniform() * 1.4 - 0.2) * lon_span);
+				break;
+			case 1:
+				points.push_back(a);
+				break;
+			case 2:
+			{
+				size_t e = rng.below(v.size());
+				const GPS_Coordinate &s = v[e];
+				const GPS_Coordinate &t = v[(e + 1) % v.size()];
+				float u = rng.uniform();
+				points.emplace_back(s.latitude + u * (t.latitude - s.latitude), s.longitude + u * (t.longitude - s.longitude));
+				break;
+			}
+			default:
+				points.emplace_back(a.latitude, b.longitude + (rng.uniform() - 0.5) * lon_span * 0.1f);
+				break;
+		}
+	}
+	return points;
+}
+
+/**
+ * @brief Compare every query implementation on a fence against the reference ones.
+ *
+ * @param fence fence to check, its index must be current
+ * @param points query points
+ * @param verbose print every mismatch
+ * @return number of mismatches
+ */
+int differential_check_fence(const GeoFence &fence, const std::vector<GPS_Coordinate> &points, bool verbose = false)
+{
+	int mismatches = 0;
+	GeoFence stale;    // same vertices without an index, exercises the fallback scan
+	stale.boundary_coordinates = fence.boundary_coordinates;
+
+	for (const auto &p : points)
+	{
+		bool expected_inside = reference_is_inside(fence.boundary_coordinates, p);
+		bool indexed_inside = fence.is_inside(p);
+		bool fallback_inside = stale.is_inside(p);
+		if (indexed_inside != expected_inside || fallback_inside != expected_inside)
+		{
+			mismatches++;
+			if (verbose)
+				printf("\tis_inside mismatch at (%.7f, %.7f): reference %d, indexed %d, fallback %d\n", p.latitude, p.longitude,
+				       expected_inside, indexed_inside, fallback_inside);
+		}
+
+		double expected_distance = reference_distance_to_boundary(fence.boundary_coordinates, p);
+		double distance = fence.distance_to_boundary(p);
+		if (fabs(distance - expected_distance) > 1e-6 + 1e-9 * expected_distance)
+		{
+			mismatches++;
+			if (verbose)
+				printf("\tdistance_to_boundary mismatch at (%.7f, %.7f): reference %f, got %f\n", p.latitude, p.longitude,
+				       expected_distance, distance);
+		}
+	}
+	return mismatches;
+}
+
+/**
+ * @brief Random differential campaign, prints a summary and returns the number of mismatches.
+ *
+ * @param fences number of random fences
+ * @param seed first seed, fence k uses seed + k so a failure can be replayed alone
+ */
+int differential_run(int fences, uint32_t seed = 1)
+{
+	int mismatches = 0;
+	long queries = 0;
+	for (int k = 0; k < fences; k++)
+	{
+		DifferentialRandom rng(seed + k);
+		GeoFence fence;
+		int vertices = 3 + rng.below((k % 10 == 0) ? 2000 : 60);
+		if (k % 5 == 1)
+			differential_random_convex_polygon(fence, rng, vertices);
+		else
+			differential_random_polygon(fence, rng, vertices, k % 3 == 0);
+		std::vector<GPS_Coordinate> points = differential_query_points(fence, rng, 64);
+		int found = differential_check_fence(fence, points);
+		if (found)
+		{
+			printf("\tseed %u: %d mismatches on %d vertices\n", (unsigned)(seed + k), found, vertices);
+			differential_check_fence(fence, points, true);
+		}
+		mismatches += found;
+		queries += points.size();
+	}
+	printf("\t%d fences, %ld queries, %d mismatches\n", fences, queries, mismatches);
+	return mismatches;
+}
+
+/**
+ * @brief Short differential run for test_geofence().
+ *
+ * @return int
+ */
+bool test_differential_random_fences()
+{
+	printf("test_differential_random_fences()\n");
+	if (differential_run(200) == 0)
+	{
+		printf("\ttest_differential_random_fences() passed.\n");
+		return 1;
+	}
+	printf("\ttest_differential_random_fences() failed.\n");
+	return 0;
+}
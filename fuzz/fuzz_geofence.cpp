@@ -0,0 +1,80 @@
+/**
+ * @file fuzz_geofence.cpp
+ * @brief libFuzzer entry point, the input bytes are decoded into a fence and query points that are checked with
+ * differential_check_fence() and GeoFence_Validator, any disagreement with the reference algorithms aborts.
+ *
+ * Build and run (clang):
+ *   clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined -I.. fuzz_geofence.cpp -o fuzz_geofence
+ *   ./fuzz_geofence corpus/
+ *
+ * Without libFuzzer, -DGEOFENCE_FUZZ_STANDALONE builds a main() that replays the files given on the command line.
+ */
+#include "../geofence.h"
+#include "../geofence_validate.h"
+#include "../class_differential.h"
+#include <cstdint>
+#include <cstdlib>
+
+/**
+ * @brief Every 4 bytes become one coordinate, each 16 bit half is a latitude/longitude on a small grid around a base point so the
+ * fuzzer easily hits repeated vertices, horizontal edges and points on the boundary. The first byte says how many coordinates are
+ * fence vertices, the rest are query points.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (size < 1 + 3 * 4) return 0;
+	size_t coordinates = (size - 1) / 4;
+	size_t vertices = 3 + data[0] % 64;
+	if (vertices > coordinates) vertices = coordinates;
+
+	GeoFence fence;
+	std::vector<GPS_Coordinate> points;
+	for (size_t k = 0; k < coordinates; k++)
+	{
+		const uint8_t *c = data + 1 + 4 * k;
+		int lat_step = (int)(c[0] | (c[1] << 8)) - 32768;
+		int lon_step = (int)(c[2] | (c[3] << 8)) - 32768;
+		float lat = -23.21f + lat_step * 1e-6f;
+		float lon = -45.90f + lon_step * 1e-6f;
+		if (k < vertices)
+			fence.add_point(lat, lon);
+		else
+			points.emplace_back(lat, lon);
+	}
+	// the vertices themselves are always queried too
+	points.insert(points.end(), fence.boundary_coordinates.begin(), fence.boundary_coordinates.end());
+
+	if (differential_check_fence(fence, points, true) != 0) abort();
+
+	std::vector<GPS_Coordinate> distinct;
+	const std::vector<GPS_Coordinate> &v = fence.boundary_coordinates;
+	for (size_t k = 0; k < v.size(); k++)
+	{
+		const GPS_Coordinate &next = v[(k + 1) % v.size()];
+		if (v[k].latitude != next.latitude || v[k].longitude != next.longitude) distinct.push_back(v[k]);
+	}
+	size_t edge, other_edge;
+	if (GeoFence_Validator::find_self_intersection(distinct, edge, other_edge) != reference_self_intersection(distinct)) abort();
+	return 0;
+}
+
+#ifdef GEOFENCE_FUZZ_STANDALONE
+#include <cstdio>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		FILE *f = fopen(argv[i], "rb");
+		if (!f) continue;
+		std::vector<uint8_t> bytes;
+		int c;
+		while ((c = fgetc(f)) != EOF) bytes.push_back((uint8_t)c);
+		fclose(f);
+		LLVMFuzzerTestOneInput(bytes.data(), bytes.size());
+		printf("%s: ok\n", argv[i]);
+	}
+	return 0;
+}
+#endif
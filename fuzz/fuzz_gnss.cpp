@@ -0,0 +1,77 @@
+/**
+ * @file fuzz_gnss.cpp
+ * @brief libFuzzer entry point for GeoFence_GnssParser, the input bytes are parsed at once and again in pieces of every size from 1
+ * to 16 bytes, both must give the same fixes and counters. Any difference or sanitizer report is a bug in the state machine.
+ *
+ * Build and run (clang):
+ *   clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined -I.. fuzz_gnss.cpp -o fuzz_gnss
+ *   ./fuzz_gnss corpus/
+ *
+ * Without libFuzzer, -DGEOFENCE_FUZZ_STANDALONE builds a main() that replays the files given on the command line.
+ */
+#include "../geofence_gnss.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+static void parse_all(const uint8_t *data, size_t size, size_t piece, std::vector<GeoFence_Fix> &fixes, GeoFence_GnssCounters &counters)
+{
+	GeoFence_GnssParser parser;
+	GeoFence_FixBatch batch;
+	for (size_t offset = 0; offset < size;)
+	{
+		size_t end = std::min(size, offset + piece);
+		while (offset < end)
+		{
+			offset += parser.parse(data + offset, end - offset, batch);
+			fixes.insert(fixes.end(), batch.fixes, batch.fixes + batch.count);
+			batch.clear();
+		}
+	}
+	counters = parser.counters;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	std::vector<GeoFence_Fix> expected;
+	GeoFence_GnssCounters expected_counters;
+	parse_all(data, size, size ? size : 1, expected, expected_counters);
+
+	for (size_t piece = 1; piece <= 16; piece++)
+	{
+		std::vector<GeoFence_Fix> fixes;
+		GeoFence_GnssCounters counters;
+		parse_all(data, size, piece, fixes, counters);
+		if (fixes.size() != expected.size() || memcmp(&counters, &expected_counters, sizeof(counters)) != 0) abort();
+		for (size_t k = 0; k < fixes.size(); k++)
+		{
+			if (memcmp(&fixes[k].latitude, &expected[k].latitude, sizeof(float)) != 0 ||
+			    memcmp(&fixes[k].longitude, &expected[k].longitude, sizeof(float)) != 0 ||
+			    fixes[k].time_of_day_ms != expected[k].time_of_day_ms || fixes[k].unix_time_ms != expected[k].unix_time_ms ||
+			    fixes[k].source != expected[k].source)
+				abort();
+		}
+	}
+	return 0;
+}
+
+#ifdef GEOFENCE_FUZZ_STANDALONE
+#include <cstdio>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		FILE *f = fopen(argv[i], "rb");
+		if (!f) continue;
+		std::vector<uint8_t> bytes;
+		int c;
+		while ((c = fgetc(f)) != EOF) bytes.push_back((uint8_t)c);
+		fclose(f);
+		LLVMFuzzerTestOneInput(bytes.data(), bytes.size());
+		printf("%s: ok\n", argv[i]);
+	}
+	return 0;
+}
+#endif
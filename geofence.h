@@ -3,6 +3,9 @@
 #include <cmath>    // Include cmath for math functions and M_PI
 #include <limits>   // Include limits for numeric_limits
 #include <cstdio>   // Include cstdio for printf
+#include <cstddef>  // Include cstddef for size_t
+#include <algorithm>
+#include "geofence_stats.h"
 
 // Detect environment and include appropriate headers
 #if defined(_WIN32) || defined(__linux__)
@@ -26,6 +29,94 @@ class GPS_Coordinate
 	GPS_Coordinate(float lat, float lon) : latitude(lat), longitude(lon) {}
 };
 
+#ifndef GEOFENCE_EDGE_BLOCK_SIZE
+#define GEOFENCE_EDGE_BLOCK_SIZE 32    // edges per index block, blocks are split when they grow past twice this size
+#endif
+
+/**
+ * @brief Axis aligned bounding box in decimal degrees.
+ */
+class GeoFence_BoundingBox
+{
+   public:
+	float min_latitude;
+	float max_latitude;
+	float min_longitude;
+	float max_longitude;
+
+	GeoFence_BoundingBox() { reset(); }
+
+	void reset()
+	{
+		min_latitude = std::numeric_limits<float>::max();
+		max_latitude = -std::numeric_limits<float>::max();
+		min_longitude = std::numeric_limits<float>::max();
+		max_longitude = -std::numeric_limits<float>::max();
+	}
+
+	bool is_empty() const { return min_latitude > max_latitude; }
+
+	void expand(const GPS_Coordinate &c)
+	{
+		min_latitude = std::min(min_latitude, c.latitude);
+		max_latitude = std::max(max_latitude, c.latitude);
+		min_longitude = std::min(min_longitude, c.longitude);
+		max_longitude = std::max(max_longitude, c.longitude);
+	}
+
+	void expand(const GeoFence_BoundingBox &other)
+	{
+		min_latitude = std::min(min_latitude, other.min_latitude);
+		max_latitude = std::max(max_latitude, other.max_latitude);
+		min_longitude = std::min(min_longitude, other.min_longitude);
+		max_longitude = std::max(max_longitude, other.max_longitude);
+	}
+
+	bool contains(const GPS_Coordinate &c) const
+	{
+		return c.latitude >= min_latitude && c.latitude <= max_latitude && c.longitude >= min_longitude && c.longitude <= max_longitude;
+	}
+
+	bool overlaps(const GeoFence_BoundingBox &other) const
+	{
+		return min_latitude <= other.max_latitude && other.min_latitude <= max_latitude && min_longitude <= other.max_longitude &&
+		       other.min_longitude <= max_longitude;
+	}
+};
+
+/**
+ * @brief A run of consecutive fence edges and their bounding box. Edge e goes from vertex e to vertex (e + 1) % n.
+ */
+class GeoFence_EdgeBlock
+{
+   public:
+	size_t first_edge;
+	size_t edge_count;
+	GeoFence_BoundingBox bounds;
+	double sphere_min[3];    // box around the unit vectors of the block vertices, bounds distance_to_boundary() from below
+	double sphere_max[3];
+
+	GeoFence_EdgeBlock(size_t first, size_t count) : first_edge(first), edge_count(count) {}
+};
+
+/**
+ * @brief A point where a trajectory segment crosses the fence boundary, see GeoFence::segment_crossings().
+ */
+class GeoFence_Crossing
+{
+   public:
+	size_t edge_index;       // edge from vertex edge_index to vertex (edge_index + 1) % n
+	GPS_Coordinate point;    // interpolated crossing point
+	double fraction;         // position along the segment, 0 at the first fix and 1 at the second
+	double time;             // interpolated between the two fix times
+	bool entering;           // true if the trajectory is inside the fence right after this crossing
+
+	GeoFence_Crossing(size_t edge, const GPS_Coordinate &p, double t, double when, bool in)
+	    : edge_index(edge), point(p), fraction(t), time(when), entering(in)
+	{
+	}
+};
+
 /**
  * @brief This class help to create a polygon geofence, it can support as many points as your stack can hold.  Tested with 99 points.
  *
@@ -49,11 +140,26 @@ class GPS_Coordinate
  * count is odd, the point is inside the polygon. If it's even, the point is outside.
  *
  * This algorithm works for convex and concave polygons, but it assumes that the polygon's vertices are ordered in a counterclockwise
- * manner. For more complex cases, such as self-intersecting polygons, additional checks might be needed.
+ * manner. For more complex cases, such as self-intersecting polygons, additional checks might be needed. GeoFence_Validator in
+ * geofence_validate.h checks both after an import and fixes the orientation, repeated and collinear vertices.
  *
  * Keep in mind that this algorithm assumes a 2D plane and doesn't account for the curvature of the Earth's surface when dealing with GPS
  * coordinates. For accurate geographic calculations, a more sophisticated library that considers the Earth's geometry is recommended.
  *
+ * The edges are grouped in blocks of GEOFENCE_EDGE_BLOCK_SIZE with a bounding box each, so is_inside() only tests the blocks that
+ * straddle the latitude of the point. The blocks are kept up to date by add_point(), insert_point(), move_point() and remove_point(),
+ * each edit only touches the blocks holding the edges next to the edited vertex. If boundary_coordinates is changed directly, call
+ * rebuild_index() afterwards. Resizing it, or writing through edit_coordinates(), makes the queries fall back to testing every edge
+ * until then.
+ *
+ * The edits also keep track of the shape: turn direction at each vertex, winding (signed area) and how many vertices are local
+ * extremes in latitude. When the fence is monotone in latitude (true for every convex fence) only two edges can cross the horizontal
+ * line through a point, is_inside() then finds them with a binary search on the two chains instead of scanning blocks. The answer is
+ * the same as the ray cast, bit for bit, and it applies to monotone fences of any size. distance_to_boundary() visits the blocks nearest
+ * first and skips the ones that can't hold an edge closer than the best found so far. It still computes a bound for every block, so it
+ * is O(n / GEOFENCE_EDGE_BLOCK_SIZE) plus the edges of the blocks it can't skip. A fence with a single block (up to
+ * GEOFENCE_EDGE_BLOCK_SIZE vertices, like the 4 point samples) has nothing to skip and just tests every edge.
+ *
  */
 class GeoFence
 {
@@ -66,9 +172,396 @@ class GeoFence
 	 */
 	static double degrees_to_radians(double degrees) { return degrees * IMPL_M_PI / 180.0; }
 
+	std::vector<GeoFence_EdgeBlock> edge_blocks;
+	GeoFence_BoundingBox bounds;
+	size_t indexed_vertices = 0;    // number of vertices the edge blocks were built for
+
+	// shape of the fence, kept up to date by the edits, see is_convex()
+	long shape_left_turns = 0;
+	long shape_right_turns = 0;
+	long shape_extremes = 0;            // runs of equal latitude vertices that are a local minimum or maximum
+	double shape_twice_area = 0;        // shoelace sum in the longitude (x) / latitude (y) plane
+	size_t shape_lowest_vertex = 0;     // ends of the two monotone chains, only meaningful when is_latitude_monotone()
+	size_t shape_highest_vertex = 0;
+#ifdef GEOFENCE_ENABLE_STATS
+	mutable GeoFence_OperationCounters stats_is_inside;
+	mutable GeoFence_OperationCounters stats_distance_to_boundary;
+#endif
+
+	/**
+	 * @brief Crossing of the segment from -> to with edge a -> b, in the same latitude/longitude plane as is_inside(). A vertex lying
+	 * exactly on the segment line counts as being on its left side, so a segment that only touches a vertex crosses both of its edges or
+	 * none of them, never just one. Returns the fraction along the segment in (0, 1] or -1 when there is no crossing.
+	 */
+	static double segment_edge_crossing(const GPS_Coordinate &from, const GPS_Coordinate &to, const GPS_Coordinate &a, const GPS_Coordinate &b)
+	{
+		double dx = (double)to.longitude - from.longitude, dy = (double)to.latitude - from.latitude;
+		double side_a = dx * ((double)a.latitude - from.latitude) - dy * ((double)a.longitude - from.longitude);
+		double side_b = dx * ((double)b.latitude - from.latitude) - dy * ((double)b.longitude - from.longitude);
+		if ((side_a >= 0) == (side_b >= 0)) return -1;    // both vertices on the same side of the segment line
+
+		double ex = (double)b.longitude - a.longitude, ey = (double)b.latitude - a.latitude;
+		double denominator = dx * ey - dy * ex;
+		if (denominator == 0) return -1;
+		double t = (((double)a.longitude - from.longitude) * ey - ((double)a.latitude - from.latitude) * ex) / denominator;
+		if (t <= 0 || t > 1) return -1;    // half open so a fix exactly on the boundary is counted by one segment only
+		return t;
+	}
+
+	/**
+	 * @brief Ray cast test of a single edge, vertex_i is the edge end and vertex_j the edge start (same order as the original loop).
+	 */
+	static bool edge_crosses_ray(const GPS_Coordinate &vertex_i, const GPS_Coordinate &vertex_j, const GPS_Coordinate &p)
+	{
+		if ((vertex_i.latitude < p.latitude && vertex_j.latitude >= p.latitude) ||
+		    (vertex_j.latitude < p.latitude && vertex_i.latitude >= p.latitude))
+		{
+			if (vertex_i.longitude + (p.latitude - vertex_i.latitude) / (vertex_j.latitude - vertex_i.latitude) *
+			                             (vertex_j.longitude - vertex_i.longitude) <
+			    p.longitude)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const GPS_Coordinate &vertex_before(size_t k) const
+	{
+		size_t n = boundary_coordinates.size();
+		return boundary_coordinates[(k + n - 1) % n];
+	}
+
+	const GPS_Coordinate &vertex_after(size_t k) const { return boundary_coordinates[(k + 1) % boundary_coordinates.size()]; }
+
+	/**
+	 * @brief Turn direction at vertex k, 1 left (counterclockwise), -1 right, 0 straight.
+	 */
+	int vertex_turn(size_t k) const
+	{
+		const GPS_Coordinate &a = vertex_before(k), &b = boundary_coordinates[k], &c = vertex_after(k);
+		double cross = ((double)b.longitude - a.longitude) * ((double)c.latitude - b.latitude) -
+		               ((double)b.latitude - a.latitude) * ((double)c.longitude - b.longitude);
+		return (cross > 0) - (cross < 0);
+	}
+
+	/**
+	 * @brief Start of the run of equal latitude vertices holding vertex k (k itself when the whole fence is one run).
+	 */
+	size_t latitude_run_start(size_t k) const
+	{
+		size_t n = boundary_coordinates.size();
+		size_t start = k;
+		for (size_t steps = 0; steps < n && vertex_before(start).latitude == boundary_coordinates[k].latitude; steps++)
+			start = (start + n - 1) % n;
+		return start;
+	}
+
+	/**
+	 * @brief For the first vertex of a run of equal latitude vertices: -1 if the vertices around the run are both higher (a local
+	 * minimum), 1 if both are lower. 0 for a run that goes on up or down, and for vertices that don't start a run.
+	 */
+	int vertex_extreme(size_t k) const
+	{
+		size_t n = boundary_coordinates.size();
+		float lat = boundary_coordinates[k].latitude;
+		if (vertex_before(k).latitude == lat) return 0;
+		size_t end = k;
+		while (vertex_after(end).latitude == lat) end = (end + 1) % n;    // ends, vertex k - 1 has another latitude
+		float before = vertex_before(k).latitude, after = vertex_after(end).latitude;
+		if (before > lat && after > lat) return -1;
+		if (before < lat && after < lat) return 1;
+		return 0;
+	}
+
+	double edge_area_term(size_t e) const
+	{
+		const GPS_Coordinate &a = boundary_coordinates[e], &b = vertex_after(e);
+		return (double)a.longitude * b.latitude - (double)b.longitude * a.latitude;
+	}
+
+	void account_run_shape(size_t start, int sign)
+	{
+		int extreme = vertex_extreme(start);
+		if (extreme != 0) shape_extremes += sign;
+		if (sign > 0 && extreme < 0) shape_lowest_vertex = start;
+		if (sign > 0 && extreme > 0) shape_highest_vertex = start;
+	}
+
+	/**
+	 * @brief Add (sign 1) or remove (sign -1) the shape counters that depend on vertices first to last (at most 3 consecutive vertices):
+	 * their turns, the edges between them and the latitude runs holding them (a run only depends on its vertices and its two neighbours).
+	 */
+	void account_shape(size_t first, size_t count, int sign)
+	{
+		size_t n = boundary_coordinates.size();
+		size_t starts[3];
+		size_t distinct = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t k = (first + i) % n;
+			int turn = vertex_turn(k);
+			if (turn > 0) shape_left_turns += sign;
+			if (turn < 0) shape_right_turns += sign;
+			if (i + 1 < count) shape_twice_area += sign * edge_area_term(k);
+
+			size_t start = latitude_run_start(k);
+			bool seen = false;
+			for (size_t j = 0; j < distinct; j++) seen = seen || starts[j] == start;
+			if (!seen) starts[distinct++] = start;
+		}
+		for (size_t j = 0; j < distinct; j++) account_run_shape(starts[j], sign);
+	}
+
+	void recompute_shape()
+	{
+		shape_left_turns = shape_right_turns = shape_extremes = 0;
+		shape_twice_area = 0;
+		for (size_t k = 0; k < boundary_coordinates.size(); k++)
+		{
+			int turn = vertex_turn(k);
+			if (turn > 0) shape_left_turns++;
+			if (turn < 0) shape_right_turns++;
+			shape_twice_area += edge_area_term(k);
+			account_run_shape(k, 1);
+		}
+	}
+
+	/**
+	 * @brief After an edit the chain ends may have moved to vertices the edit didn't touch, find them again (only happens when the fence
+	 * becomes monotone).
+	 */
+	void repair_chain_ends()
+	{
+		if (shape_extremes != 2 || boundary_coordinates.size() < 3) return;
+		if (vertex_extreme(shape_lowest_vertex) == -1 && vertex_extreme(shape_highest_vertex) == 1) return;
+		for (size_t k = 0; k < boundary_coordinates.size(); k++)
+		{
+			int extreme = vertex_extreme(k);
+			if (extreme < 0) shape_lowest_vertex = k;
+			if (extreme > 0) shape_highest_vertex = k;
+		}
+	}
+
+	/**
+	 * @brief Find the edge of a monotone chain that straddles latitude, walking count edges from vertex start. rising tells if the chain
+	 * latitude goes up or down. Returns false when no edge of the chain straddles it.
+	 */
+	bool find_chain_edge(size_t start, size_t count, bool rising, float latitude, size_t &edge) const
+	{
+		size_t n = boundary_coordinates.size();
+		// past(t): vertex t of the chain is on the far side of latitude, false at the start of the chain and true at its end
+		auto past = [&](size_t t)
+		{
+			float lat = boundary_coordinates[(start + t) % n].latitude;
+			return rising ? (lat >= latitude) : (lat < latitude);
+		};
+		if (past(0) || !past(count)) return false;
+		size_t lo = 0, hi = count;
+		while (hi - lo > 1)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (past(mid))
+				hi = mid;
+			else
+				lo = mid;
+		}
+		edge = (start + lo) % n;
+		return true;
+	}
+
+	/**
+	 * @brief Box around the unit sphere vectors of every point with latitude/longitude in the bounding box (so also around any chord
+	 * between two of them, which is what calculate_distance_to_segment() measures to).
+	 */
+	static void sphere_box(const GeoFence_BoundingBox &b, double box_min[3], double box_max[3])
+	{
+		double lat1 = degrees_to_radians(b.min_latitude), lat2 = degrees_to_radians(b.max_latitude);
+		double lon1 = degrees_to_radians(b.min_longitude), lon2 = degrees_to_radians(b.max_longitude);
+		double cos_lat_min = -1, cos_lat_max = 1, sin_lat_min = -1, sin_lat_max = 1;
+		if (b.min_latitude >= -90 && b.max_latitude <= 90)
+		{
+			cos_lat_min = std::min(cos(lat1), cos(lat2));
+			cos_lat_max = (b.min_latitude <= 0 && b.max_latitude >= 0) ? 1 : std::max(cos(lat1), cos(lat2));
+			sin_lat_min = sin(lat1);
+			sin_lat_max = sin(lat2);
+		}
+		double cos_lon_min = -1, cos_lon_max = 1, sin_lon_min = -1, sin_lon_max = 1;
+		if (b.min_longitude >= -180 && b.max_longitude <= 180)
+		{
+			cos_lon_min = (b.min_longitude <= -180 || b.max_longitude >= 180) ? -1 : std::min(cos(lon1), cos(lon2));
+			cos_lon_max = (b.min_longitude <= 0 && b.max_longitude >= 0) ? 1 : std::max(cos(lon1), cos(lon2));
+			sin_lon_min = (b.min_longitude <= -90 && b.max_longitude >= -90) ? -1 : std::min(sin(lon1), sin(lon2));
+			sin_lon_max = (b.min_longitude <= 90 && b.max_longitude >= 90) ? 1 : std::max(sin(lon1), sin(lon2));
+		}
+		double x[4] = {cos_lat_min * cos_lon_min, cos_lat_min * cos_lon_max, cos_lat_max * cos_lon_min, cos_lat_max * cos_lon_max};
+		double y[4] = {cos_lat_min * sin_lon_min, cos_lat_min * sin_lon_max, cos_lat_max * sin_lon_min, cos_lat_max * sin_lon_max};
+		const double margin = 1e-9;    // covers the rounding of the trig functions
+		box_min[0] = *std::min_element(x, x + 4) - margin;
+		box_max[0] = *std::max_element(x, x + 4) + margin;
+		box_min[1] = *std::min_element(y, y + 4) - margin;
+		box_max[1] = *std::max_element(y, y + 4) + margin;
+		box_min[2] = sin_lat_min - margin;
+		box_max[2] = sin_lat_max + margin;
+	}
+
+	/**
+	 * @brief Lower bound, in meters, of calculate_distance_to_segment() from the unit vector p to any edge of a block.
+	 */
+	static double block_distance_lower_bound(const GeoFence_EdgeBlock &block, const double p[3])
+	{
+		double squared = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			double d = std::max(0.0, std::max(block.sphere_min[axis] - p[axis], p[axis] - block.sphere_max[axis]));
+			squared += d * d;
+		}
+		return sqrt(squared) * 6371.0 * 1000;
+	}
+
+	/**
+	 * @brief Index of the block holding an edge, binary search over the block start edges.
+	 */
+	size_t find_edge_block(size_t edge) const
+	{
+		size_t lo = 0, hi = edge_blocks.size();
+		while (hi - lo > 1)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (edge_blocks[mid].first_edge <= edge)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	void refresh_block_bounds(size_t block)
+	{
+		size_t numVertices = boundary_coordinates.size();
+		GeoFence_EdgeBlock &b = edge_blocks[block];
+		b.bounds.reset();
+		for (size_t e = b.first_edge; e < b.first_edge + b.edge_count; e++)
+		{
+			b.bounds.expand(boundary_coordinates[e]);
+			b.bounds.expand(boundary_coordinates[(e + 1) % numVertices]);
+		}
+		sphere_box(b.bounds, b.sphere_min, b.sphere_max);
+	}
+
+	void refresh_fence_bounds()
+	{
+		bounds.reset();
+		for (const auto &b : edge_blocks) bounds.expand(b.bounds);
+	}
+
+	static bool touches_extreme(const GeoFence_BoundingBox &block, const GeoFence_BoundingBox &fence)
+	{
+		return block.min_latitude <= fence.min_latitude || block.max_latitude >= fence.max_latitude ||
+		       block.min_longitude <= fence.min_longitude || block.max_longitude >= fence.max_longitude;
+	}
+
+	/**
+	 * @brief Refresh the blocks holding the two edges that touch a vertex, and the fence bounding box. The fence box is only rebuilt
+	 * from all blocks when a vertex went away (can_shrink) and one of the refreshed blocks was holding an extreme, otherwise it is just
+	 * expanded.
+	 */
+	void refresh_around_vertex(size_t vertex, bool can_shrink)
+	{
+		size_t numVertices = boundary_coordinates.size();
+		size_t before = find_edge_block((vertex + numVertices - 1) % numVertices);
+		size_t after = find_edge_block(vertex % numVertices);
+		bool full_refresh =
+		    can_shrink && (touches_extreme(edge_blocks[before].bounds, bounds) || touches_extreme(edge_blocks[after].bounds, bounds));
+		refresh_block_bounds(before);
+		if (after != before) refresh_block_bounds(after);
+		if (full_refresh)
+		{
+			refresh_fence_bounds();
+			return;
+		}
+		bounds.expand(edge_blocks[before].bounds);
+		bounds.expand(edge_blocks[after].bounds);
+	}
+
+	/**
+	 * @brief Shape counters after a vertex was inserted at index, the counters of its old neighbours were already removed when
+	 * incremental is true, otherwise everything is recomputed (small fences).
+	 */
+	void update_shape_after_insert(size_t index, bool incremental)
+	{
+		size_t n = boundary_coordinates.size();
+		if (!incremental)
+		{
+			recompute_shape();
+			return;
+		}
+		if (shape_lowest_vertex >= index) shape_lowest_vertex++;
+		if (shape_highest_vertex >= index) shape_highest_vertex++;
+		account_shape(index + n - 1, 3, 1);
+		repair_chain_ends();
+	}
+
+	void update_shape_after_remove(size_t index, bool incremental)
+	{
+		size_t n = boundary_coordinates.size();
+		if (!incremental)
+		{
+			recompute_shape();
+			return;
+		}
+		if (shape_lowest_vertex > index) shape_lowest_vertex--;
+		if (shape_highest_vertex > index) shape_highest_vertex--;
+		shape_lowest_vertex %= n;
+		shape_highest_vertex %= n;
+		account_shape(index + n - 1, 2, 1);
+		repair_chain_ends();
+	}
+
+	/**
+	 * @brief Merge a block that removals left with less than half of GEOFENCE_EDGE_BLOCK_SIZE edges into its smaller neighbour, so
+	 * deleting most of a large fence doesn't leave a trail of tiny blocks. The merged block is split again if it got too big.
+	 */
+	void merge_block_if_needed(size_t block)
+	{
+		if (edge_blocks.size() < 2 || edge_blocks[block].edge_count >= GEOFENCE_EDGE_BLOCK_SIZE / 2) return;
+		bool with_next = block == 0;
+		if (block > 0 && block + 1 < edge_blocks.size()) with_next = edge_blocks[block + 1].edge_count < edge_blocks[block - 1].edge_count;
+		size_t lower = with_next ? block : block - 1;
+		edge_blocks[lower].edge_count += edge_blocks[lower + 1].edge_count;
+		edge_blocks.erase(edge_blocks.begin() + lower + 1);
+		refresh_block_bounds(lower);
+		split_block_if_needed(lower);
+	}
+
+	void split_block_if_needed(size_t block)
+	{
+		if (edge_blocks[block].edge_count <= 2 * GEOFENCE_EDGE_BLOCK_SIZE) return;
+		size_t half = edge_blocks[block].edge_count / 2;
+		GeoFence_EdgeBlock upper(edge_blocks[block].first_edge + half, edge_blocks[block].edge_count - half);
+		edge_blocks[block].edge_count = half;
+		edge_blocks.insert(edge_blocks.begin() + block + 1, upper);
+		refresh_block_bounds(block);
+		refresh_block_bounds(block + 1);
+	}
+
+	unsigned long coordinates_generation = 0;    // bumped by edit_coordinates(), the index is stale until rebuild_index()
+	unsigned long indexed_generation = 0;
+
    public:
 	std::vector<GPS_Coordinate> boundary_coordinates;
 
+	/**
+	 * @brief boundary_coordinates for bulk edits in place. The index is marked stale, the queries test every edge until rebuild_index()
+	 * is called. Writing boundary_coordinates directly is only noticed when its size changes, call rebuild_index() after such writes.
+	 * Don't keep the reference past rebuild_index(), writes through it after that are not seen by the index either.
+	 */
+	std::vector<GPS_Coordinate> &edit_coordinates()
+	{
+		coordinates_generation++;
+		return boundary_coordinates;
+	}
+
 	static double haversineDistance(const GPS_Coordinate &a, const GPS_Coordinate &b)
 	{
 		const double R = 6371.0;    // Radius of Earth in km
@@ -96,11 +589,56 @@ class GeoFence
 		return minDistance * 1000;    // convert km to meters
 	}
 
-	double distance_to_boundary(const GPS_Coordinate &p, bool debug = false)
+	double distance_to_boundary(const GPS_Coordinate &p, bool debug = false) const
 	{
+		GEOFENCE_STATS(GeoFence_StatsTimer timer(stats_distance_to_boundary));
 		double min_distance = std::numeric_limits<double>::max();
 
 		int numVertices = boundary_coordinates.size();
+		if (is_index_current() && edge_blocks.size() > 1)
+		{
+			double lat = degrees_to_radians(p.latitude), lon = degrees_to_radians(p.longitude);
+			double unit[3] = {cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat)};
+			auto scan_block = [&](const GeoFence_EdgeBlock &block)
+			{
+				GEOFENCE_STATS(stats_distance_to_boundary.add(stats_distance_to_boundary.blocks_scanned, 1);
+				               stats_distance_to_boundary.add(stats_distance_to_boundary.edges_tested, block.edge_count));
+				for (size_t e = block.first_edge; e < block.first_edge + block.edge_count; e++)
+				{
+					double distance = calculate_distance_to_segment(boundary_coordinates[e], vertex_after(e), p);
+					if (distance < min_distance) min_distance = distance;
+				}
+			};
+
+			// start with the block that looks nearest, then only scan blocks that could still hold a closer edge
+			size_t nearest = 0;
+			double nearest_bound = std::numeric_limits<double>::max();
+			for (size_t b = 0; b < edge_blocks.size(); b++)
+			{
+				double bound = block_distance_lower_bound(edge_blocks[b], unit);
+				if (bound < nearest_bound)
+				{
+					nearest_bound = bound;
+					nearest = b;
+				}
+			}
+			scan_block(edge_blocks[nearest]);
+			for (size_t b = 0; b < edge_blocks.size(); b++)
+			{
+				if (b == nearest) continue;
+				if (block_distance_lower_bound(edge_blocks[b], unit) >= min_distance)
+				{
+					GEOFENCE_STATS(stats_distance_to_boundary.add(stats_distance_to_boundary.blocks_skipped, 1));
+					continue;
+				}
+				scan_block(edge_blocks[b]);
+			}
+
+			if (debug) printf("Minimum distance to boundary: %f meters\n", min_distance);
+			return min_distance;
+		}
+
+		GEOFENCE_STATS(stats_distance_to_boundary.add(stats_distance_to_boundary.edges_tested, numVertices));
 		for (int i = 0; i < numVertices; i++)
 		{
 			GPS_Coordinate A = boundary_coordinates[i];
@@ -174,7 +712,193 @@ class GeoFence
 	 * @param lat decimal latitude
 	 * @param lon decimal longitude
 	 */
-	void add_point(float lat, float lon) { boundary_coordinates.emplace_back(lat, lon); }
+	void add_point(float lat, float lon) { insert_point(boundary_coordinates.size(), lat, lon); }
+
+	/**
+	 * @brief Insert a vertex before position index (index == size appends), only the blocks next to the new vertex are refreshed.
+	 * Still O(n): the vertices after index move up in the vector and every later block's first edge is shifted (n / 32 blocks), but
+	 * both are plain memory moves, no bounds are recomputed.
+	 *
+	 * @param index position of the new vertex, 0 to number of vertices
+	 * @param lat decimal latitude
+	 * @param lon decimal longitude
+	 * @return false if index is out of range
+	 */
+	bool insert_point(size_t index, float lat, float lon)
+	{
+		size_t numVertices = boundary_coordinates.size();
+		if (index > numVertices) return false;
+		bool index_was_current = is_index_current();
+		bool incremental_shape = index_was_current && numVertices >= 3;    // the counters of small fences are just recomputed
+		if (incremental_shape) account_shape(index + numVertices - 1, 2, -1);
+		boundary_coordinates.insert(boundary_coordinates.begin() + index, GPS_Coordinate(lat, lon));
+		if (!index_was_current)
+		{
+			rebuild_index();
+			return true;
+		}
+		update_shape_after_insert(index, incremental_shape);
+
+		// the new vertex splits edge index - 1 in two, so one edge is added at position index
+		if (edge_blocks.empty())
+		{
+			edge_blocks.emplace_back(0, 0);
+		}
+		size_t block = (index < numVertices) ? find_edge_block(index) : edge_blocks.size() - 1;
+		edge_blocks[block].edge_count++;
+		for (size_t b = block + 1; b < edge_blocks.size(); b++) edge_blocks[b].first_edge++;
+		indexed_vertices++;
+		split_block_if_needed(block);
+		refresh_around_vertex(index, false);
+		return true;
+	}
+
+	/**
+	 * @brief Move an existing vertex, only the blocks holding the two edges that touch it are refreshed.
+	 *
+	 * @param index vertex to move
+	 * @param lat new decimal latitude
+	 * @param lon new decimal longitude
+	 * @return false if index is out of range
+	 */
+	bool move_point(size_t index, float lat, float lon)
+	{
+		size_t numVertices = boundary_coordinates.size();
+		if (index >= numVertices) return false;
+		if (!is_index_current())
+		{
+			boundary_coordinates[index] = GPS_Coordinate(lat, lon);
+			rebuild_index();
+			return true;
+		}
+		account_shape(index + numVertices - 1, 3, -1);
+		boundary_coordinates[index] = GPS_Coordinate(lat, lon);
+		account_shape(index + numVertices - 1, 3, 1);
+		repair_chain_ends();
+		refresh_around_vertex(index, true);
+		return true;
+	}
+
+	/**
+	 * @brief Remove a vertex, its two edges are merged into one and only the blocks next to it are refreshed. O(n) like
+	 * insert_point(), a block left with less than half of GEOFENCE_EDGE_BLOCK_SIZE edges is merged into a neighbour.
+	 *
+	 * @param index vertex to remove
+	 * @return false if index is out of range
+	 */
+	bool remove_point(size_t index)
+	{
+		size_t numVertices = boundary_coordinates.size();
+		if (index >= numVertices) return false;
+		bool index_was_current = is_index_current();
+		bool incremental_shape = index_was_current && numVertices >= 4;
+		if (incremental_shape) account_shape(index + numVertices - 1, 3, -1);
+		boundary_coordinates.erase(boundary_coordinates.begin() + index);
+		if (!index_was_current || numVertices == 1)
+		{
+			rebuild_index();
+			return true;
+		}
+		update_shape_after_remove(index, incremental_shape);
+
+		// edges index - 1 and index become a single edge, drop the one at position index
+		size_t block = find_edge_block(index);
+		edge_blocks[block].edge_count--;
+		for (size_t b = block + 1; b < edge_blocks.size(); b++) edge_blocks[b].first_edge--;
+		bool emptied = edge_blocks[block].edge_count == 0;
+		if (emptied) edge_blocks.erase(edge_blocks.begin() + block);
+		indexed_vertices--;
+		refresh_around_vertex(index % (numVertices - 1), true);
+		if (!emptied) merge_block_if_needed(block);
+		return true;
+	}
+
+	/**
+	 * @brief Rebuild every edge block from boundary_coordinates, needed only after editing boundary_coordinates directly.
+	 */
+	void rebuild_index()
+	{
+		size_t numVertices = boundary_coordinates.size();
+		edge_blocks.clear();
+		for (size_t first = 0; first < numVertices; first += GEOFENCE_EDGE_BLOCK_SIZE)
+		{
+			edge_blocks.emplace_back(first, std::min<size_t>(GEOFENCE_EDGE_BLOCK_SIZE, numVertices - first));
+			refresh_block_bounds(edge_blocks.size() - 1);
+		}
+		indexed_vertices = numVertices;
+		indexed_generation = coordinates_generation;
+		refresh_fence_bounds();
+		recompute_shape();
+		repair_chain_ends();
+	}
+
+	/**
+	 * @brief True when the edge blocks match boundary_coordinates: false after it was resized directly or handed out by
+	 * edit_coordinates(), until rebuild_index().
+	 */
+	bool is_index_current() const
+	{
+		return indexed_generation == coordinates_generation && indexed_vertices == boundary_coordinates.size();
+	}
+
+	/**
+	 * @brief Bounding box of the whole fence, empty when the fence has no vertices.
+	 */
+	const GeoFence_BoundingBox &bounding_box() const { return bounds; }
+
+	const std::vector<GeoFence_EdgeBlock> &get_edge_blocks() const { return edge_blocks; }
+
+	/**
+	 * @brief True when the boundary goes up in latitude once and down once (runs of equal latitude are fine). Every convex fence is
+	 * monotone, is_inside() is O(log n) on monotone fences.
+	 */
+	bool is_latitude_monotone() const { return is_index_current() && boundary_coordinates.size() >= 3 && shape_extremes == 2; }
+
+	/**
+	 * @brief True for convex fences: monotone and turning the same way at every vertex (straight vertices are allowed).
+	 */
+	bool is_convex() const
+	{
+		return is_latitude_monotone() && (shape_left_turns == 0 || shape_right_turns == 0) && (shape_left_turns + shape_right_turns) > 0;
+	}
+
+	/**
+	 * @brief Winding order with longitude as x and latitude as y, true for counterclockwise (positive signed area).
+	 */
+	bool is_counter_clockwise() const { return shape_twice_area > 0; }
+
+	/**
+	 * @brief Signed area in square degrees (longitude x latitude), positive when counterclockwise.
+	 */
+	double signed_area_degrees() const { return shape_twice_area / 2; }
+
+	/**
+	 * @brief Query statistics of this fence, all zero unless built with GEOFENCE_ENABLE_STATS.
+	 */
+	GeoFence_QueryStats get_stats() const
+	{
+		GeoFence_QueryStats stats;
+#ifdef GEOFENCE_ENABLE_STATS
+		stats.is_inside = stats_is_inside.snapshot();
+		stats.distance_to_boundary = stats_distance_to_boundary.snapshot();
+#endif
+		return stats;
+	}
+
+	void reset_stats()
+	{
+#ifdef GEOFENCE_ENABLE_STATS
+		stats_is_inside.restore(GeoFence_OperationStats());
+		stats_distance_to_boundary.restore(GeoFence_OperationStats());
+#endif
+	}
+
+	/**
+	 * @brief Print the query statistics with printf, like the debug output of the queries.
+	 *
+	 * @param fence_name name printed in the header line
+	 */
+	void print_stats(const char *fence_name = "fence") const { get_stats().print(fence_name); }
 
 	/**
 	 * @brief Check if a point is inside the geofence (the geofence is created by adding points to it)
@@ -184,28 +908,59 @@ class GeoFence
 	 * @return true
 	 * @return false
 	 */
-	bool is_inside(const GPS_Coordinate &p, bool debug = false)
+	bool is_inside(const GPS_Coordinate &p, bool debug = false) const
 	{
 		int numVertices = boundary_coordinates.size();
 		int j = numVertices - 1;
 		bool inside = false;
-		static int counter_of_calls = 0;
-		counter_of_calls++;
-
-		for (int i = 0; i < numVertices; i++)
+		GEOFENCE_STATS(GeoFence_StatsTimer timer(stats_is_inside));
+		if (is_index_current())
 		{
-			if ((boundary_coordinates[i].latitude < p.latitude && boundary_coordinates[j].latitude >= p.latitude) ||
-			    (boundary_coordinates[j].latitude < p.latitude && boundary_coordinates[i].latitude >= p.latitude))
+			// no edge can cross the latitude of a point above or below the whole fence
+			if (bounds.is_empty() || bounds.max_latitude < p.latitude || bounds.min_latitude >= p.latitude)
 			{
-				if (boundary_coordinates[i].longitude + (p.latitude - boundary_coordinates[i].latitude) /
-				                                            (boundary_coordinates[j].latitude - boundary_coordinates[i].latitude) *
-				                                            (boundary_coordinates[j].longitude - boundary_coordinates[i].longitude) <
-				    p.longitude)
-				{
+				GEOFENCE_STATS(stats_is_inside.add(stats_is_inside.early_rejections, 1));
+			}
+			else if (is_latitude_monotone())
+			{
+				// only one edge of each chain can straddle the latitude, every other edge would fail the ray cast test anyway
+				size_t low = shape_lowest_vertex, high = shape_highest_vertex;
+				size_t edge;
+				if (find_chain_edge(low, (high + numVertices - low) % numVertices, true, p.latitude, edge) &&
+				    edge_crosses_ray(vertex_after(edge), boundary_coordinates[edge], p))
+					inside = !inside;
+				if (find_chain_edge(high, (low + numVertices - high) % numVertices, false, p.latitude, edge) &&
+				    edge_crosses_ray(vertex_after(edge), boundary_coordinates[edge], p))
 					inside = !inside;
+				GEOFENCE_STATS(stats_is_inside.add(stats_is_inside.edges_tested, 2));
+			}
+			else
+			{
+				GEOFENCE_STATS(geofence_stats_counter_t blocks_scanned = 0, edges_tested = 0);
+				// only blocks with a vertex on each side of the point latitude can hold a crossing edge
+				for (const auto &block : edge_blocks)
+				{
+					if (block.bounds.max_latitude < p.latitude || block.bounds.min_latitude >= p.latitude) continue;
+					GEOFENCE_STATS(blocks_scanned++, edges_tested += block.edge_count);
+					for (size_t e = block.first_edge; e < block.first_edge + block.edge_count; e++)
+					{
+						size_t i = (e + 1) % numVertices;
+						if (edge_crosses_ray(boundary_coordinates[i], boundary_coordinates[e], p)) inside = !inside;
+					}
 				}
+				GEOFENCE_STATS(stats_is_inside.add(stats_is_inside.blocks_scanned, blocks_scanned);
+				               stats_is_inside.add(stats_is_inside.blocks_skipped, edge_blocks.size() - blocks_scanned);
+				               stats_is_inside.add(stats_is_inside.edges_tested, edges_tested));
+			}
+		}
+		else
+		{
+			GEOFENCE_STATS(stats_is_inside.add(stats_is_inside.edges_tested, numVertices));
+			for (int i = 0; i < numVertices; i++)
+			{
+				if (edge_crosses_ray(boundary_coordinates[i], boundary_coordinates[j], p)) inside = !inside;
+				j = i;
 			}
-			j = i;
 		}
 
 		if (debug)
@@ -214,6 +969,65 @@ class GeoFence
 		return inside;
 	}
 
+	/**
+	 * @brief Every boundary crossing of the straight segment between two fixes, sorted along the segment. Use it when fixes are far
+	 * apart: a vehicle can cut a fence corner between two fixes that are both outside, which is_inside() can't see. The edge blocks
+	 * whose bounding box doesn't overlap the segment are skipped, so for short segments it costs about one is_inside() call.
+	 *
+	 * @param from previous fix
+	 * @param from_time time of the previous fix (any unit)
+	 * @param to current fix
+	 * @param to_time time of the current fix, same unit
+	 * @param starts_inside is_inside() of the previous fix (the caller usually has it already), used to fill GeoFence_Crossing::entering
+	 * @param crossings cleared and filled with the crossings
+	 * @return number of crossings, an odd number means the inside/outside state changed
+	 */
+	size_t segment_crossings(const GPS_Coordinate &from, double from_time, const GPS_Coordinate &to, double to_time, bool starts_inside,
+	                         std::vector<GeoFence_Crossing> &crossings) const
+	{
+		crossings.clear();
+		size_t numVertices = boundary_coordinates.size();
+		if (numVertices < 2) return 0;
+
+		GeoFence_BoundingBox segment;
+		segment.expand(from);
+		segment.expand(to);
+		auto test_edge = [&](size_t e)
+		{
+			const GPS_Coordinate &a = boundary_coordinates[e];
+			const GPS_Coordinate &b = boundary_coordinates[(e + 1) % numVertices];
+			double t = segment_edge_crossing(from, to, a, b);
+			if (t < 0) return;
+			GPS_Coordinate point(from.latitude + t * ((double)to.latitude - from.latitude),
+			                     from.longitude + t * ((double)to.longitude - from.longitude));
+			crossings.emplace_back(e, point, t, from_time + t * (to_time - from_time), false);
+		};
+
+		if (is_index_current())
+		{
+			if (!bounds.overlaps(segment)) return 0;
+			for (const auto &block : edge_blocks)
+			{
+				if (!block.bounds.overlaps(segment)) continue;
+				for (size_t e = block.first_edge; e < block.first_edge + block.edge_count; e++) test_edge(e);
+			}
+		}
+		else
+		{
+			for (size_t e = 0; e < numVertices; e++) test_edge(e);
+		}
+
+		std::sort(crossings.begin(), crossings.end(),
+		          [](const GeoFence_Crossing &x, const GeoFence_Crossing &y) { return x.fraction < y.fraction; });
+		bool inside = starts_inside;
+		for (auto &c : crossings)
+		{
+			inside = !inside;
+			c.entering = inside;
+		}
+		return crossings.size();
+	}
+
 	/**
 	 * @brief Calculate the distance between two points, this function uses approximate values for the radius of the earth instead of an
 	 * geoid model for faster calculation.
@@ -0,0 +1,432 @@
+/**
+ * @file geofence_async.h
+ * @brief Fence queries answered on another core. The time critical task (GPS UART, modem) posts fixes to a single producer, single
+ * consumer ring and never runs is_inside() or distance_to_boundary() itself. A worker pinned to the other core evaluates them and
+ * hands the results to a callback or to a second queue that the caller polls.
+ *
+ * On ESP32 the worker is a FreeRTOS task created with xTaskCreatePinnedToCore() and woken by a task notification, post() never
+ * blocks. On Linux and Windows it is a std::thread (pthreads on Linux, pinned with pthread_setaffinity_np) with the same API, so the
+ * code runs on a PC without hardware. There the wakeup is a counting semaphore (sem_t on Linux, a kernel semaphore on Windows) that
+ * post() releases without taking any lock, and only when the worker is asleep: that post pays one system call (counted in wakeups),
+ * the others are just the ring push. Other Arduino boards have no second core, post() evaluates the query inline there.
+ *
+ * Usage:
+ *   GeoFence_AsyncEvaluator evaluator(fences);        // fences must not change while the worker runs
+ *   evaluator.start(1);                               // worker on core 1, the UART/modem tasks stay on core 0
+ *   evaluator.post(query);                            // from the GPS task, false when the queue is full
+ *   GeoFence_AsyncQuery result;
+ *   while (evaluator.poll(result)) use(result);       // result.fix.fence, result.distance_m
+ *   evaluator.stop();
+ */
+#pragma once
+#include "geofence.h"
+#include "geofence_gnss.h"
+#include <atomic>
+#include <cstdint>
+
+#if defined(ESP32)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#elif defined(_WIN32) || defined(__linux__)
+#include <thread>
+#include <chrono>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <time.h>
+#endif
+#endif
+
+#ifndef GEOFENCE_ASYNC_QUEUE_SIZE
+#define GEOFENCE_ASYNC_QUEUE_SIZE 32    // queries (and results) in flight, one slot of each queue stays empty
+#endif
+
+#ifndef GEOFENCE_ASYNC_TASK_STACK
+#define GEOFENCE_ASYNC_TASK_STACK 4096    // bytes of stack for the esp32 worker task
+#endif
+
+#ifndef GEOFENCE_ASYNC_TASK_PRIORITY
+#define GEOFENCE_ASYNC_TASK_PRIORITY 5    // FreeRTOS priority of the esp32 worker task
+#endif
+
+enum GeoFence_AsyncFlags
+{
+	GEOFENCE_ASYNC_INSIDE = 1,      // set fix.fence to the first fence that contains the fix, or -1
+	GEOFENCE_ASYNC_DISTANCE = 2     // set distance_m to the distance to the nearest fence boundary
+};
+
+/**
+ * @brief A query on its way to the worker, and the same record with the answers on the way back.
+ */
+class GeoFence_AsyncQuery
+{
+   public:
+	GeoFence_Fix fix;
+	uint32_t tag = 0;     // returned unchanged, for the caller to match results to queries
+	uint8_t flags = GEOFENCE_ASYNC_INSIDE;
+	float distance_m = NAN;
+};
+
+#if !defined(ESP32) && (defined(_WIN32) || defined(__linux__))
+/**
+ * @brief Counting semaphore that wakes the PC worker, release() takes no lock (a futex on Linux) and only enters the kernel when
+ * a thread is waiting.
+ */
+class GeoFence_WakeSemaphore
+{
+   private:
+#if defined(_WIN32)
+	HANDLE handle;
+#else
+	sem_t semaphore;
+#endif
+
+   public:
+#if defined(_WIN32)
+	GeoFence_WakeSemaphore() { handle = CreateSemaphore(nullptr, 0, 0x7FFFFFFF, nullptr); }
+	~GeoFence_WakeSemaphore() { CloseHandle(handle); }
+	void release() { ReleaseSemaphore(handle, 1, nullptr); }
+	void wait_ms(uint32_t ms) { WaitForSingleObject(handle, ms); }
+#else
+	GeoFence_WakeSemaphore() { sem_init(&semaphore, 0, 0); }
+	~GeoFence_WakeSemaphore() { sem_destroy(&semaphore); }
+	void release() { sem_post(&semaphore); }
+
+	/**
+	 * @brief Take one count, waiting up to ms for it. Returns early on a signal, the caller checks its state again anyway.
+	 */
+	void wait_ms(uint32_t ms)
+	{
+		timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);    // sem_timedwait() takes a CLOCK_REALTIME deadline
+		until.tv_nsec += (long)(ms % 1000) * 1000000;
+		until.tv_sec += ms / 1000 + until.tv_nsec / 1000000000;
+		until.tv_nsec %= 1000000000;
+		sem_timedwait(&semaphore, &until);
+	}
+#endif
+
+	GeoFence_WakeSemaphore(const GeoFence_WakeSemaphore &) = delete;
+	GeoFence_WakeSemaphore &operator=(const GeoFence_WakeSemaphore &) = delete;
+};
+#endif
+
+/**
+ * @brief Lock-free ring for one producer thread and one consumer thread, Capacity - 1 items fit.
+ */
+template <typename T, size_t Capacity>
+class GeoFence_SpscQueue
+{
+   private:
+	T items[Capacity];
+	std::atomic<size_t> head{0};    // next slot to write, only the producer stores it
+	std::atomic<size_t> tail{0};    // next slot to read, only the consumer stores it
+
+   public:
+	bool push(const T &item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t next = (h + 1) % Capacity;
+		if (next == tail.load(std::memory_order_acquire)) return false;
+		items[h] = item;
+		head.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return false;
+		item = items[t];
+		tail.store((t + 1) % Capacity, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const { return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire); }
+	bool full() const { return (head.load(std::memory_order_acquire) + 1) % Capacity == tail.load(std::memory_order_acquire); }
+};
+
+class GeoFence_AsyncEvaluator
+{
+   public:
+	typedef void (*Callback)(const GeoFence_AsyncQuery &result, void *context);
+
+   private:
+	const std::vector<GeoFence> &fences;
+	Callback callback;
+	void *callback_context;
+	GeoFence_SpscQueue<GeoFence_AsyncQuery, GEOFENCE_ASYNC_QUEUE_SIZE> queries;
+	GeoFence_SpscQueue<GeoFence_AsyncQuery, GEOFENCE_ASYNC_QUEUE_SIZE> results;
+	std::atomic<bool> running{false};
+	std::atomic<bool> stopping{false};           // set by stop(), deliver() then drops results that don't fit instead of waiting
+	std::atomic<bool> waiting_to_deliver{false};    // the worker is waiting for room in the result queue
+
+#if defined(ESP32)
+	TaskHandle_t worker = nullptr;
+	SemaphoreHandle_t worker_done = nullptr;    // given by the worker when it leaves its loop, stop() deletes it after that
+#elif defined(_WIN32) || defined(__linux__)
+	std::thread worker;
+	GeoFence_WakeSemaphore wake;
+	std::atomic<bool> sleeping{false};    // the worker may be waiting on wake, post() only releases it then
+#endif
+
+	void evaluate(GeoFence_AsyncQuery &query) const
+	{
+		GPS_Coordinate p = query.fix.coordinate();
+		if (query.flags & GEOFENCE_ASYNC_INSIDE)
+		{
+			query.fix.fence = -1;
+			for (size_t i = 0; i < fences.size(); i++)
+			{
+				if (fences[i].is_inside(p))
+				{
+					query.fix.fence = (int)i;
+					break;
+				}
+			}
+		}
+		if (query.flags & GEOFENCE_ASYNC_DISTANCE)
+		{
+			double nearest = std::numeric_limits<double>::max();
+			for (const GeoFence &fence : fences) nearest = std::min(nearest, fence.distance_to_boundary(p));
+			query.distance_m = (float)nearest;
+		}
+	}
+
+	/**
+	 * @brief Hand a result over, waiting while the result queue is full (the queries queue then fills up and post() says so). Once
+	 * stop() was called a result that doesn't fit is dropped and counted in dropped.
+	 */
+	void deliver(const GeoFence_AsyncQuery &result)
+	{
+		if (callback)
+		{
+			callback(result, callback_context);
+			return;
+		}
+		while (!results.push(result))
+		{
+			if (stopping.load() || !running.load())
+			{
+				dropped++;
+				break;
+			}
+			waiting_to_deliver.store(true);
+#if defined(ESP32)
+			vTaskDelay(1);
+#elif defined(_WIN32) || defined(__linux__)
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+		}
+		waiting_to_deliver.store(false);
+	}
+
+	void drain()
+	{
+		GeoFence_AsyncQuery query;
+		while (queries.pop(query))
+		{
+			evaluate(query);
+			evaluated++;
+			deliver(query);
+		}
+	}
+
+#if defined(ESP32)
+	static void worker_task(void *arg)
+	{
+		GeoFence_AsyncEvaluator *self = (GeoFence_AsyncEvaluator *)arg;
+		while (self->running.load())
+		{
+			self->drain();
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+		}
+		// stop() deletes the task, so its handle stays valid for the notifications sent until then
+		xSemaphoreGive(self->worker_done);
+		vTaskSuspend(nullptr);
+	}
+#elif defined(_WIN32) || defined(__linux__)
+	void worker_loop()
+	{
+		while (running.load())
+		{
+			drain();
+			sleeping.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);    // pairs with the fence in post(), one of the two sees the other
+			if (queries.empty() && running.load()) wake.wait_ms(100);    // a count left by an earlier post only costs one more pass
+			sleeping.store(false);
+		}
+	}
+#endif
+
+   public:
+	uint32_t posted = 0;       // queries accepted by post(), producer side
+	uint32_t rejected = 0;     // queries post() refused because the queue was full, producer side
+	uint32_t wakeups = 0;      // posts that signalled the worker: all of them on esp32, on a PC those that found it asleep, producer side
+	std::atomic<uint32_t> evaluated{0};
+	std::atomic<uint32_t> dropped{0};    // results discarded by stop() because the result queue was full and nobody polled it
+
+	/**
+	 * @param callback when given, called on the worker for every result instead of queueing it for poll(), keep it short
+	 */
+	GeoFence_AsyncEvaluator(const std::vector<GeoFence> &fence_list, Callback result_callback = nullptr, void *context = nullptr)
+	    : fences(fence_list), callback(result_callback), callback_context(context)
+	{
+	}
+
+	GeoFence_AsyncEvaluator(const GeoFence_AsyncEvaluator &) = delete;
+	GeoFence_AsyncEvaluator &operator=(const GeoFence_AsyncEvaluator &) = delete;
+
+	~GeoFence_AsyncEvaluator()
+	{
+		stop();
+#if defined(ESP32)
+		if (worker_done) vSemaphoreDelete(worker_done);
+#endif
+	}
+
+	/**
+	 * @brief Start the worker.
+	 *
+	 * @param core core to pin the worker to, -1 lets the scheduler pick
+	 * @return false if it is already running or could not be created
+	 */
+	bool start(int core = 1)
+	{
+		if (running.load()) return false;
+		stopping.store(false);
+		running.store(true);
+		for (GeoFence_AsyncQuery query; results.pop(query);) {}
+#if defined(ESP32)
+		if (!worker_done) worker_done = xSemaphoreCreateBinary();
+		if (!worker_done)
+		{
+			running.store(false);
+			return false;
+		}
+		BaseType_t created = xTaskCreatePinnedToCore(worker_task, "geofence", GEOFENCE_ASYNC_TASK_STACK, this, GEOFENCE_ASYNC_TASK_PRIORITY,
+		                                             &worker, core < 0 ? tskNO_AFFINITY : core);
+		if (created != pdPASS) running.store(false);
+		return created == pdPASS;
+#elif defined(_WIN32) || defined(__linux__)
+		worker = std::thread(&GeoFence_AsyncEvaluator::worker_loop, this);
+#if defined(__linux__)
+		if (core >= 0 && core < CPU_SETSIZE)
+		{
+			cpu_set_t cores;
+			CPU_ZERO(&cores);
+			CPU_SET(core, &cores);
+			pthread_setaffinity_np(worker.native_handle(), sizeof(cores), &cores);    // best effort, fails on machines with fewer cores
+		}
+#else
+		(void)core;
+#endif
+		return true;
+#else
+		(void)core;
+		return true;
+#endif
+	}
+
+	/**
+	 * @brief Stop the worker once it has answered the queries already posted. Without a callback, results that no longer fit in the
+	 * result queue are dropped (counted in dropped). Stop posting first, post() must not run while stop() does.
+	 */
+	void stop()
+	{
+		if (!running.load()) return;
+		stopping.store(true);
+#if defined(ESP32)
+		drain_wait();
+		TaskHandle_t task = worker;
+		running.store(false);
+		xTaskNotifyGive(task);
+		xSemaphoreTake(worker_done, portMAX_DELAY);
+		vTaskDelete(task);
+		worker = nullptr;
+#elif defined(_WIN32) || defined(__linux__)
+		drain_wait();
+		running.store(false);
+		wake.release();
+		worker.join();
+#else
+		running.store(false);
+#endif
+	}
+
+	/**
+	 * @brief Wait until the worker has taken every posted query.
+	 *
+	 * @return false when it gave up because the worker is waiting for room in the result queue, poll() the results and try again
+	 */
+	bool drain_wait()
+	{
+		while (running.load() && !queries.empty())
+		{
+			if (waiting_to_deliver.load() && !stopping.load()) return false;
+#if defined(ESP32)
+			vTaskDelay(1);
+#elif defined(_WIN32) || defined(__linux__)
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Queue a query for the worker, never blocks. When the worker is asleep this also wakes it: a task notification on ESP32,
+	 * a semaphore release (one system call, no lock) on a PC. Call it from one task only.
+	 *
+	 * @return false when the queue is full (or the evaluator is stopped), the query is dropped
+	 */
+	bool post(const GeoFence_AsyncQuery &query)
+	{
+#if defined(ESP32) || defined(_WIN32) || defined(__linux__)
+		if (!running.load() || !queries.push(query))
+		{
+			rejected++;
+			return false;
+		}
+		posted++;
+#if defined(ESP32)
+		wakeups++;
+		xTaskNotifyGive(worker);
+#else
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleeping.load())
+		{
+			wakeups++;
+			wake.release();
+		}
+#endif
+		return true;
+#else
+		// single core boards: answer right away
+		if (!running.load() || results.full())
+		{
+			rejected++;
+			return false;
+		}
+		posted++;
+		GeoFence_AsyncQuery result = query;
+		evaluate(result);
+		evaluated++;
+		deliver(result);
+		return true;
+#endif
+	}
+
+	/**
+	 * @brief Take the next result when no callback was given. Call it from one task only.
+	 */
+	bool poll(GeoFence_AsyncQuery &result) { return results.pop(result); }
+
+	bool is_running() const { return running.load(); }
+};
@@ -0,0 +1,337 @@
+/**
+ * @file geofence_devices.h
+ * @brief Inside/outside state of many devices against one group of fences, kept as flat arrays (struct of arrays) instead of an
+ * object per device.
+ *
+ * Every device gets a dense index. Its fence memberships are one bit per fence, next to its last fix, the fix time (unix_time_ms),
+ * the distance to the nearest fence edge and its clearance. Both are measured from the point where the memberships were last computed
+ * (the anchor), in the latitude/longitude plane with the longitude scaled by the cosine of the anchor latitude. Straight lines
+ * stay straight under that scaling, so no edge can be crossed on the way from the anchor to any fix closer than the clearance, and
+ * all the memberships are still right. update() only runs is_inside() on the devices that left their clearance disk.
+ *
+ * Usage:
+ *   GeoFence_DeviceStore store(fences);                // fences must stay alive and unchanged while the store uses them
+ *   std::vector<GeoFence_DeviceEvent> events;
+ *   store.update(device_ids, fixes, count, &events);   // events lists the fences entered and left
+ *   bool inside = store.is_inside(store.find(id), 3);
+ */
+#pragma once
+#include "geofence.h"
+#include "geofence_gnss.h"
+#include <cstdint>
+#include <limits>
+
+#ifndef GEOFENCE_DEVICE_MAX_CLEARANCE
+#define GEOFENCE_DEVICE_MAX_CLEARANCE 0.1    // degrees, edges farther than this are not searched, a device re-evaluates after moving it
+#endif
+
+#ifndef GEOFENCE_DEVICE_CLEARANCE_MARGIN
+#define GEOFENCE_DEVICE_CLEARANCE_MARGIN 1e-5    // degrees taken off every clearance, covers the float rounding of is_inside()
+#endif
+
+#define GEOFENCE_DEVICE_METERS_PER_DEGREE 111195.0    // along a meridian, 6371 km earth radius
+#define GEOFENCE_DEVICE_EMPTY_SLOT 0xFFFFFFFFu
+
+/**
+ * @brief A device entered (or left) a fence, reported by GeoFence_DeviceStore::update().
+ */
+class GeoFence_DeviceEvent
+{
+   public:
+	uint64_t device_id;
+	uint32_t fence;
+	bool entered;
+	uint64_t unix_time_ms;    // of the fix that crossed the boundary
+};
+
+/**
+ * @brief Open addressing hash from external device ids to dense indices 0..n-1, two flat arrays and linear probing.
+ */
+class GeoFence_DeviceIndex
+{
+   private:
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> slots;    // dense index per slot, GEOFENCE_DEVICE_EMPTY_SLOT when unused
+	size_t used = 0;
+
+	static uint64_t hash(uint64_t id)
+	{
+		// splitmix64 finalizer, sequential ids spread over the whole table
+		id ^= id >> 30;
+		id *= 0xBF58476D1CE4E5B9ULL;
+		id ^= id >> 27;
+		id *= 0x94D049BB133111EBULL;
+		return id ^ (id >> 31);
+	}
+
+	void grow()
+	{
+		std::vector<uint64_t> old_keys;
+		std::vector<uint32_t> old_slots;
+		old_keys.swap(keys);
+		old_slots.swap(slots);
+		size_t capacity = old_slots.empty() ? 1024 : old_slots.size() * 2;
+		keys.assign(capacity, 0);
+		slots.assign(capacity, GEOFENCE_DEVICE_EMPTY_SLOT);
+		for (size_t k = 0; k < old_slots.size(); k++)
+		{
+			if (old_slots[k] == GEOFENCE_DEVICE_EMPTY_SLOT) continue;
+			size_t s = probe(old_keys[k]);
+			keys[s] = old_keys[k];
+			slots[s] = old_slots[k];
+		}
+	}
+
+	// slot holding id, or the free slot where it would go
+	size_t probe(uint64_t id) const
+	{
+		size_t mask = slots.size() - 1;
+		size_t s = hash(id) & mask;
+		while (slots[s] != GEOFENCE_DEVICE_EMPTY_SLOT && keys[s] != id) s = (s + 1) & mask;
+		return s;
+	}
+
+   public:
+	size_t size() const { return used; }
+
+	int find(uint64_t id) const
+	{
+		if (slots.empty()) return -1;
+		uint32_t index = slots[probe(id)];
+		return index == GEOFENCE_DEVICE_EMPTY_SLOT ? -1 : (int)index;
+	}
+
+	/**
+	 * @brief Dense index of id, a new id gets the next free one (size() before the call).
+	 */
+	uint32_t find_or_insert(uint64_t id, bool &inserted)
+	{
+		if ((used + 1) * 10 > slots.size() * 7) grow();    // keep the load under 70%
+		size_t s = probe(id);
+		inserted = slots[s] == GEOFENCE_DEVICE_EMPTY_SLOT;
+		if (inserted)
+		{
+			keys[s] = id;
+			slots[s] = (uint32_t)used++;
+		}
+		return slots[s];
+	}
+
+	size_t memory_bytes() const { return keys.capacity() * sizeof(uint64_t) + slots.capacity() * sizeof(uint32_t); }
+};
+
+class GeoFence_DeviceStore
+{
+   private:
+	const std::vector<GeoFence> &fences;
+	size_t words;    // membership words per device
+
+	GeoFence_DeviceIndex index;
+	std::vector<uint64_t> ids;            // external id of every dense index
+	std::vector<float> latitudes, longitudes;
+	std::vector<uint64_t> times;          // unix_time_ms of the last fix
+	std::vector<float> anchor_latitudes, anchor_longitudes;
+	std::vector<float> anchor_scales;     // cosine of the anchor latitude
+	std::vector<float> distances;         // degrees in the scaled plane from the anchor to the nearest edge, not capped
+	std::vector<float> clearances;        // the distance capped and less the margin, negative forces an evaluation
+	std::vector<uint64_t> memberships;    // words bits per device, bit f for fence f
+
+	/**
+	 * @brief Distance in the plane around the anchor (longitude scaled by scale) from (0, 0) to the box.
+	 */
+	static double box_distance(const GeoFence_BoundingBox &box, double lat0, double lon0, double scale)
+	{
+		double dx = std::max(0.0, std::max(box.min_longitude - lon0, lon0 - box.max_longitude)) * scale;
+		double dy = std::max(0.0, std::max(box.min_latitude - lat0, lat0 - box.max_latitude));
+		return sqrt(dx * dx + dy * dy);
+	}
+
+	static double segment_distance(const GPS_Coordinate &a, const GPS_Coordinate &b, double lat0, double lon0, double scale)
+	{
+		double ax = (a.longitude - lon0) * scale, ay = a.latitude - lat0;
+		double bx = (b.longitude - lon0) * scale, by = b.latitude - lat0;
+		double dx = bx - ax, dy = by - ay;
+		double length = dx * dx + dy * dy;
+		double t = length > 0 ? -(ax * dx + ay * dy) / length : 0;
+		t = std::max(0.0, std::min(1.0, t));
+		double x = ax + t * dx, y = ay + t * dy;
+		return sqrt(x * x + y * y);
+	}
+
+	/**
+	 * @brief Lower nearest to the distance from the anchor to the edges of fence, only blocks that could be closer are scanned.
+	 */
+	static void fence_nearest(const GeoFence &fence, double lat0, double lon0, double scale, double &nearest)
+	{
+		const std::vector<GPS_Coordinate> &v = fence.boundary_coordinates;
+		size_t n = v.size();
+		if (!fence.is_index_current())
+		{
+			for (size_t e = 0; e < n; e++) nearest = std::min(nearest, segment_distance(v[e], v[(e + 1) % n], lat0, lon0, scale));
+			return;
+		}
+		for (const GeoFence_EdgeBlock &block : fence.get_edge_blocks())
+		{
+			if (box_distance(block.bounds, lat0, lon0, scale) >= nearest) continue;
+			for (size_t e = block.first_edge; e < block.first_edge + block.edge_count; e++)
+				nearest = std::min(nearest, segment_distance(v[e], v[(e + 1) % n], lat0, lon0, scale));
+		}
+	}
+
+	static double longitude_scale(double latitude) { return cos(latitude * IMPL_M_PI / 180.0); }
+
+	static GeoFence_BoundingBox fence_box(const GeoFence &fence)
+	{
+		if (fence.is_index_current()) return fence.bounding_box();
+		GeoFence_BoundingBox box;
+		for (const GPS_Coordinate &c : fence.boundary_coordinates) box.expand(c);
+		return box;
+	}
+
+	/**
+	 * @brief Run is_inside() against every fence whose box holds the fix, store the new memberships, the anchor, the distance to the
+	 * nearest edge and the clearance, and report the changes.
+	 */
+	void evaluate(uint32_t device, const GeoFence_Fix &fix, std::vector<GeoFence_DeviceEvent> *events)
+	{
+		double lat0 = fix.latitude, lon0 = fix.longitude, scale = longitude_scale(lat0);
+		GPS_Coordinate p = fix.coordinate();
+		uint64_t *bits = &memberships[device * words];
+		double nearest = GEOFENCE_DEVICE_MAX_CLEARANCE;
+		for (size_t f = 0; f < fences.size(); f++)
+		{
+			const GeoFence &fence = fences[f];
+			GeoFence_BoundingBox box = fence_box(fence);
+			bool inside = box.contains(p) && fence.is_inside(p);
+			bool was_inside = (bits[f / 64] >> (f % 64)) & 1;
+			if (inside != was_inside)
+			{
+				bits[f / 64] ^= (uint64_t)1 << (f % 64);
+				if (events) events->push_back({ids[device], (uint32_t)f, inside, fix.unix_time_ms});
+			}
+			if (box_distance(box, lat0, lon0, scale) < nearest) fence_nearest(fence, lat0, lon0, scale, nearest);
+		}
+		if (nearest >= GEOFENCE_DEVICE_MAX_CLEARANCE)
+		{
+			// no edge within the cap, a second pass without it finds the real distance (rare in a covered area)
+			nearest = std::numeric_limits<double>::infinity();
+			for (const GeoFence &fence : fences)
+			{
+				if (box_distance(fence_box(fence), lat0, lon0, scale) < nearest) fence_nearest(fence, lat0, lon0, scale, nearest);
+			}
+		}
+		anchor_latitudes[device] = fix.latitude;
+		anchor_longitudes[device] = fix.longitude;
+		anchor_scales[device] = (float)scale;
+		distances[device] = (float)nearest;
+		clearances[device] = (float)(std::min(nearest, (double)GEOFENCE_DEVICE_MAX_CLEARANCE) - GEOFENCE_DEVICE_CLEARANCE_MARGIN);
+	}
+
+	bool within_clearance(uint32_t device, const GeoFence_Fix &fix) const
+	{
+		double dx = ((double)fix.longitude - anchor_longitudes[device]) * anchor_scales[device];
+		double dy = (double)fix.latitude - anchor_latitudes[device];
+		double c = clearances[device];
+		return c > 0 && dx * dx + dy * dy < c * c;
+	}
+
+   public:
+	uint64_t evaluations = 0;    // device updates that ran is_inside()
+	uint64_t skipped = 0;        // device updates answered by the clearance alone
+
+	GeoFence_DeviceStore(const std::vector<GeoFence> &fence_list) : fences(fence_list), words((fence_list.size() + 63) / 64) {}
+
+	size_t device_count() const { return ids.size(); }
+	size_t fence_count() const { return fences.size(); }
+
+	/**
+	 * @brief Dense index of a device, -1 when it has not been seen.
+	 */
+	int find(uint64_t device_id) const { return index.find(device_id); }
+
+	uint64_t device_id(size_t device) const { return ids[device]; }
+	float latitude(size_t device) const { return latitudes[device]; }
+	float longitude(size_t device) const { return longitudes[device]; }
+	uint64_t unix_time_ms(size_t device) const { return times[device]; }
+	bool is_inside(size_t device, size_t fence) const { return (memberships[device * words + fence / 64] >> (fence % 64)) & 1; }
+
+	/**
+	 * @brief Lower bound, in meters, of the distance from the last fix of a device to the nearest fence edge. It is not the distance
+	 * itself: the clearance is capped at GEOFENCE_DEVICE_MAX_CLEARANCE (about 11 km) less GEOFENCE_DEVICE_CLEARANCE_MARGIN, shrinks as
+	 * the device moves away from its anchor and is 0 once the device left its clearance disk or after invalidate(). See
+	 * evaluated_distance_m() for the actual distance.
+	 */
+	double clearance_lower_bound_m(size_t device) const
+	{
+		double dx = ((double)longitudes[device] - anchor_longitudes[device]) * anchor_scales[device];
+		double dy = (double)latitudes[device] - anchor_latitudes[device];
+		return std::max(0.0, clearances[device] - sqrt(dx * dx + dy * dy)) * GEOFENCE_DEVICE_METERS_PER_DEGREE;
+	}
+
+	/**
+	 * @brief Distance in meters from the last fix that ran is_inside() (the anchor) to the nearest fence edge, not capped. It is
+	 * measured in the plane around the anchor like the clearance, which is within 0.1% of GeoFence::distance_to_boundary() up to tens
+	 * of kilometers. Fixes answered by the clearance alone don't update it. Infinite when there are no fences.
+	 */
+	double evaluated_distance_m(size_t device) const { return distances[device] * GEOFENCE_DEVICE_METERS_PER_DEGREE; }
+
+	/**
+	 * @brief Re-evaluate every device on its next fix, after the fences were edited.
+	 */
+	void invalidate() { std::fill(clearances.begin(), clearances.end(), -1.0f); }
+
+	/**
+	 * @brief Record a batch of fixes, fix k belongs to device_ids[k]. New devices are added.
+	 *
+	 * @param events when given, the fences entered and left are appended to it (a new device enters the fences it starts in)
+	 * @return number of fixes that had to run is_inside()
+	 */
+	size_t update(const uint64_t *device_ids, const GeoFence_Fix *fixes, size_t count, std::vector<GeoFence_DeviceEvent> *events = nullptr)
+	{
+		size_t evaluated = 0;
+		for (size_t k = 0; k < count; k++)
+		{
+			bool inserted;
+			uint32_t device = index.find_or_insert(device_ids[k], inserted);
+			if (inserted)
+			{
+				ids.push_back(device_ids[k]);
+				latitudes.push_back(0);
+				longitudes.push_back(0);
+				times.push_back(0);
+				anchor_latitudes.push_back(0);
+				anchor_longitudes.push_back(0);
+				anchor_scales.push_back(1);
+				distances.push_back(0);
+				clearances.push_back(-1);
+				memberships.resize(memberships.size() + words, 0);
+			}
+			const GeoFence_Fix &fix = fixes[k];
+			latitudes[device] = fix.latitude;
+			longitudes[device] = fix.longitude;
+			times[device] = fix.unix_time_ms;
+			if (within_clearance(device, fix))
+				continue;
+			evaluate(device, fix, events);
+			evaluated++;
+		}
+		evaluations += evaluated;
+		skipped += count - evaluated;
+		return evaluated;
+	}
+
+	size_t update(const uint64_t *device_ids, const GeoFence_FixBatch &batch, std::vector<GeoFence_DeviceEvent> *events = nullptr)
+	{
+		return update(device_ids, batch.fixes, batch.count, events);
+	}
+
+	/**
+	 * @brief Heap memory held by the store.
+	 */
+	size_t memory_bytes() const
+	{
+		size_t floats = latitudes.capacity() + longitudes.capacity() + anchor_latitudes.capacity() + anchor_longitudes.capacity() +
+		                anchor_scales.capacity() + distances.capacity() + clearances.capacity();
+		return index.memory_bytes() + (ids.capacity() + times.capacity() + memberships.capacity()) * sizeof(uint64_t) + floats * sizeof(float);
+	}
+};
@@ -0,0 +1,697 @@
+/**
+ * @file geofence_gnss.h
+ * @brief Streaming NMEA ($xxRMC, $xxGGA) and u-blox UBX (NAV-PVT) parser that turns raw receiver bytes into fixes for fence queries.
+ *
+ * The parser is a byte at a time state machine: fields are converted while they stream past and the checksums are updated on the
+ * same pass, so no sentence or message is ever copied or buffered and nothing is allocated. Its state lives across calls, a sentence
+ * may be split at any byte between two reads. Fixes go into a fixed size GeoFence_FixBatch that is evaluated against the fences in
+ * one go.
+ *
+ * Usage:
+ *   GeoFence_ByteRing ring;                            // filled by the UART task/interrupt with ring.write()
+ *   GeoFence_GnssParser parser;
+ *   GeoFence_FixBatch batch;
+ *   while (parser.parse(ring, batch) > 0 || batch.count > 0)
+ *   {
+ *       batch.evaluate(fences);                        // batch.fixes[k].fence is the first fence containing fix k, or -1
+ *       batch.clear();
+ *   }
+ */
+#pragma once
+#include "geofence.h"
+#include <atomic>
+#include <cstdint>
+
+#ifndef GEOFENCE_FIX_BATCH_SIZE
+#define GEOFENCE_FIX_BATCH_SIZE 64    // fixes per GeoFence_FixBatch
+#endif
+
+#ifndef GEOFENCE_GNSS_RING_SIZE
+#define GEOFENCE_GNSS_RING_SIZE 4096    // bytes in a GeoFence_ByteRing, must be a power of two
+#endif
+
+#ifndef GEOFENCE_NMEA_MAX_LENGTH
+#define GEOFENCE_NMEA_MAX_LENGTH 120    // longer sentences are dropped, the standard allows 82 characters but some receivers go over
+#endif
+
+#ifndef GEOFENCE_UBX_MAX_LENGTH
+#define GEOFENCE_UBX_MAX_LENGTH 1024    // larger UBX payload lengths are taken as noise and the parser resynchronizes
+#endif
+
+#define GEOFENCE_KNOTS_TO_MPS 0.514444
+
+enum GeoFence_FixSource
+{
+	GEOFENCE_FIX_NMEA_RMC = 1,
+	GEOFENCE_FIX_NMEA_GGA = 2,
+	GEOFENCE_FIX_UBX_NAV_PVT = 4,
+	GEOFENCE_FIX_ALL = 7
+};
+
+/**
+ * @brief One position from the receiver. speed_mps is NAN when the message has none ($xxGGA), a $xxGGA also has no date and takes it
+ * from the $xxRMC or NAV-PVT before it.
+ */
+class GeoFence_Fix
+{
+   public:
+	float latitude;
+	float longitude;
+	float speed_mps;
+	uint32_t time_of_day_ms;    // UTC, milliseconds since midnight
+	uint64_t unix_time_ms;      // UTC, milliseconds since 1970-01-01, 0 until the parser has seen a date
+	uint8_t source;             // GeoFence_FixSource
+	int fence;                  // set by GeoFence_FixBatch::evaluate()
+
+	GPS_Coordinate coordinate() const { return GPS_Coordinate(latitude, longitude); }
+};
+
+/**
+ * @brief Fixed size group of fixes, filled by GeoFence_GnssParser and evaluated against the fences together.
+ */
+class GeoFence_FixBatch
+{
+   public:
+	GeoFence_Fix fixes[GEOFENCE_FIX_BATCH_SIZE];
+	size_t count = 0;
+
+	bool is_full() const { return count == GEOFENCE_FIX_BATCH_SIZE; }
+	void clear() { count = 0; }
+
+	/**
+	 * @brief Set the fence of every fix to the index of the first fence that contains it, or -1.
+	 *
+	 * @return number of fixes inside any fence
+	 */
+	size_t evaluate(const std::vector<GeoFence> &fences)
+	{
+		size_t inside = 0;
+		for (size_t k = 0; k < count; k++)
+		{
+			GeoFence_Fix &fix = fixes[k];
+			GPS_Coordinate p = fix.coordinate();
+			fix.fence = -1;
+			for (size_t i = 0; i < fences.size(); i++)
+			{
+				if (fences[i].is_inside(p))
+				{
+					fix.fence = (int)i;
+					inside++;
+					break;
+				}
+			}
+		}
+		return inside;
+	}
+};
+
+/**
+ * @brief Single producer, single consumer byte ring. The producer (UART interrupt or reader task) calls write(), the consumer reads
+ * the stored bytes in place through readable() and consume(), so a parser can work straight on the ring memory.
+ */
+class GeoFence_ByteRing
+{
+   private:
+	uint8_t buffer[GEOFENCE_GNSS_RING_SIZE];
+	std::atomic<size_t> written{0};    // bytes ever written, only the producer stores it
+	std::atomic<size_t> read{0};       // bytes ever consumed, only the consumer stores it
+
+	static_assert((GEOFENCE_GNSS_RING_SIZE & (GEOFENCE_GNSS_RING_SIZE - 1)) == 0, "GEOFENCE_GNSS_RING_SIZE must be a power of two");
+
+   public:
+	size_t dropped = 0;    // bytes write() could not store, only the producer touches it
+
+	size_t size() const { return written.load(std::memory_order_acquire) - read.load(std::memory_order_acquire); }
+
+	/**
+	 * @brief Store as much of data as fits, the rest is dropped and counted.
+	 *
+	 * @return bytes stored
+	 */
+	size_t write(const uint8_t *data, size_t length)
+	{
+		size_t head = written.load(std::memory_order_relaxed);
+		size_t space = GEOFENCE_GNSS_RING_SIZE - (head - read.load(std::memory_order_acquire));
+		size_t n = std::min(length, space);
+		size_t offset = head & (GEOFENCE_GNSS_RING_SIZE - 1);
+		size_t first = std::min(n, GEOFENCE_GNSS_RING_SIZE - offset);
+		std::copy(data, data + first, buffer + offset);
+		std::copy(data + first, data + n, buffer);
+		written.store(head + n, std::memory_order_release);
+		dropped += length - n;
+		return n;
+	}
+
+	/**
+	 * @brief The oldest stored bytes that are contiguous in memory, the ones after the wrap come with the next call.
+	 *
+	 * @return number of bytes at *data
+	 */
+	size_t readable(const uint8_t **data) const
+	{
+		size_t tail = read.load(std::memory_order_relaxed);
+		size_t available = written.load(std::memory_order_acquire) - tail;
+		size_t offset = tail & (GEOFENCE_GNSS_RING_SIZE - 1);
+		*data = buffer + offset;
+		return std::min(available, GEOFENCE_GNSS_RING_SIZE - offset);
+	}
+
+	void consume(size_t length) { read.store(read.load(std::memory_order_relaxed) + length, std::memory_order_release); }
+};
+
+/**
+ * @brief Counters of what the parser has seen since it was made or reset.
+ */
+class GeoFence_GnssCounters
+{
+   public:
+	uint32_t sentences = 0;          // NMEA sentences and UBX messages with a good checksum
+	uint32_t checksum_errors = 0;
+	uint32_t malformed = 0;          // cut short, too long or with bad characters
+	uint32_t fixes = 0;              // fixes put into batches
+	uint32_t no_fix = 0;             // supported sentences that carried no valid position
+};
+
+class GeoFence_GnssParser
+{
+   private:
+	enum State
+	{
+		WAIT_SYNC,
+		NMEA_ADDRESS,
+		NMEA_FIELD,
+		NMEA_CHECKSUM_HIGH,
+		NMEA_CHECKSUM_LOW,
+		UBX_SYNC,
+		UBX_CLASS,
+		UBX_ID,
+		UBX_LENGTH_LOW,
+		UBX_LENGTH_HIGH,
+		UBX_PAYLOAD,
+		UBX_CHECKSUM_A,
+		UBX_CHECKSUM_B
+	};
+
+	// what a field of a sentence holds
+	enum Role
+	{
+		SKIP,
+		TIME,
+		STATUS,
+		LATITUDE,
+		NORTH_SOUTH,
+		LONGITUDE,
+		EAST_WEST,
+		SPEED_KNOTS,
+		QUALITY,
+		DATE
+	};
+
+	static const int max_fields = 10;
+
+	State state = WAIT_SYNC;
+	uint8_t accept;
+	const uint8_t *roles = nullptr;    // per field of the current sentence, max_fields entries
+	uint8_t sentence = 0;              // GeoFence_FixSource of the current sentence
+	uint32_t address = 0;              // last 3 characters of the address field
+	uint8_t checksum = 0;              // NMEA xor, or UBX CK_A
+	uint8_t checksum_b = 0;            // UBX CK_B
+	uint8_t received_checksum = 0;
+	uint16_t length = 0;               // NMEA characters so far, or UBX payload length
+	uint16_t offset = 0;               // UBX payload byte
+	uint8_t message_class = 0, message_id = 0;
+
+	// field being read
+	int field = 0;
+	uint64_t mantissa = 0;
+	int decimals = -1;    // digits after the point, -1 before it
+	int digits = 0;
+	char letter = 0;
+
+	// fix being assembled, the NAV-PVT fields are read straight out of the payload bytes as they pass
+	GeoFence_Fix pending;
+	bool has_time = false, has_latitude = false, has_longitude = false, valid = false;
+	int32_t sentence_days = -1;    // date field of the current RMC, days since 1970-01-01
+	uint32_t ubx_time = 0;         // hour, minute, second
+	int32_t ubx_nano = 0, ubx_longitude = 0, ubx_latitude = 0, ubx_speed = 0;
+	uint16_t ubx_year = 0;
+	uint8_t ubx_month = 0, ubx_day = 0, ubx_valid = 0, ubx_fix_type = 0, ubx_flags = 0;
+
+	// last date seen, GGA carries no date and takes it from the RMC or NAV-PVT before it
+	int32_t date_days = -1;
+	uint32_t last_time_of_day_ms = 0;
+
+	static const uint64_t *powers_of_ten()
+	{
+		static const uint64_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000, 10000000000ULL};
+		return powers;
+	}
+
+	/**
+	 * @brief Days from 1970-01-01 to a date of the proleptic Gregorian calendar (H. Hinnant's days_from_civil).
+	 */
+	static int32_t days_from_civil(int32_t year, uint32_t month, uint32_t day)
+	{
+		year -= month <= 2;
+		int32_t era = (year >= 0 ? year : year - 399) / 400;
+		uint32_t year_of_era = (uint32_t)(year - era * 400);
+		uint32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+		uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+		return era * 146097 + (int32_t)day_of_era - 719468;
+	}
+
+	/**
+	 * @brief Set unix_time_ms of the pending fix from its time of day. days is the date the sentence or message carries, -1 when it
+	 * has none: the last date seen is used then, moved to the next day when the time of day went back past midnight.
+	 */
+	void stamp_date(int32_t days)
+	{
+		if (days >= 0)
+			date_days = days;
+		else if (date_days >= 0 && pending.time_of_day_ms + 43200000 < last_time_of_day_ms)
+			date_days++;
+		last_time_of_day_ms = pending.time_of_day_ms;
+		pending.unix_time_ms = date_days < 0 ? 0 : (uint64_t)date_days * 86400000 + pending.time_of_day_ms;
+	}
+
+	static int hex_value(uint8_t c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		return -1;
+	}
+
+	void start_nmea()
+	{
+		state = NMEA_ADDRESS;
+		checksum = 0;
+		address = 0;
+		length = 0;
+	}
+
+	void start_field()
+	{
+		mantissa = 0;
+		decimals = -1;
+		digits = 0;
+		letter = 0;
+	}
+
+	/**
+	 * @brief Pick the field roles from the sentence type in the address, false for sentences we do not read.
+	 */
+	bool start_sentence()
+	{
+		static const uint8_t rmc_roles[max_fields] = {SKIP,      TIME,      STATUS,      LATITUDE, NORTH_SOUTH,
+		                                              LONGITUDE, EAST_WEST, SPEED_KNOTS, SKIP,     DATE};
+		static const uint8_t gga_roles[max_fields] = {SKIP,      TIME,      LATITUDE, NORTH_SOUTH, LONGITUDE,
+		                                              EAST_WEST, QUALITY,   SKIP,     SKIP,        SKIP};
+		if (address == (('R' << 16) | ('M' << 8) | 'C'))
+		{
+			roles = rmc_roles;
+			sentence = GEOFENCE_FIX_NMEA_RMC;
+		}
+		else if (address == (('G' << 16) | ('G' << 8) | 'A'))
+		{
+			roles = gga_roles;
+			sentence = GEOFENCE_FIX_NMEA_GGA;
+		}
+		else
+			return false;
+		if (!(accept & sentence)) return false;
+		pending.speed_mps = NAN;
+		pending.source = sentence;
+		valid = has_time = has_latitude = has_longitude = false;
+		sentence_days = -1;
+		field = 1;
+		start_field();
+		return true;
+	}
+
+	/**
+	 * @brief ddmm.mmmm (or dddmm.mmmm) to decimal degrees.
+	 */
+	double field_degrees() const
+	{
+		int d = decimals < 0 ? 0 : decimals;
+		uint64_t scale = powers_of_ten()[d];
+		uint64_t whole_degrees = mantissa / scale / 100;
+		return whole_degrees + (double)(mantissa - whole_degrees * 100 * scale) / scale / 60.0;
+	}
+
+	double field_value() const { return (double)mantissa / powers_of_ten()[decimals < 0 ? 0 : decimals]; }
+
+	void end_field()
+	{
+		if (field < max_fields && digits + (letter != 0) > 0)
+		{
+			switch (roles[field])
+			{
+			case TIME:
+			{
+				int d = decimals < 0 ? 0 : decimals;
+				uint64_t scale = powers_of_ten()[d];
+				uint32_t hhmmss = (uint32_t)(mantissa / scale);
+				pending.time_of_day_ms = (hhmmss / 10000) * 3600000 + (hhmmss / 100 % 100) * 60000 + (hhmmss % 100) * 1000 +
+				                         (uint32_t)((mantissa % scale) * 1000 / scale);
+				has_time = true;
+				break;
+			}
+			case STATUS: valid = letter == 'A'; break;
+			case LATITUDE:
+				pending.latitude = (float)field_degrees();
+				has_latitude = digits > 0;
+				break;
+			case NORTH_SOUTH:
+				if (letter == 'S') pending.latitude = -pending.latitude;
+				break;
+			case LONGITUDE:
+				pending.longitude = (float)field_degrees();
+				has_longitude = digits > 0;
+				break;
+			case EAST_WEST:
+				if (letter == 'W') pending.longitude = -pending.longitude;
+				break;
+			case SPEED_KNOTS: pending.speed_mps = (float)(field_value() * GEOFENCE_KNOTS_TO_MPS); break;
+			case QUALITY: valid = mantissa > 0; break;
+			case DATE:
+			{
+				// ddmmyy, two digit years from 80 on are taken as 19xx (GPS time starts in 1980)
+				uint32_t ddmmyy = (uint32_t)(mantissa / powers_of_ten()[decimals < 0 ? 0 : decimals]);
+				uint32_t day = ddmmyy / 10000, month = ddmmyy / 100 % 100, year = ddmmyy % 100;
+				if (day >= 1 && day <= 31 && month >= 1 && month <= 12)
+					sentence_days = days_from_civil(year < 80 ? 2000 + year : 1900 + year, month, day);
+				break;
+			}
+			}
+		}
+		field++;
+		start_field();
+	}
+
+	/**
+	 * @brief The sentence or message passed its checksum, put its fix into the batch when it has one.
+	 */
+	void emit(GeoFence_FixBatch &batch, bool has_position)
+	{
+		counters.sentences++;
+		if (!has_position)
+		{
+			counters.no_fix++;
+			return;
+		}
+		pending.fence = -1;
+		batch.fixes[batch.count++] = pending;
+		counters.fixes++;
+	}
+
+	void finish_ubx(GeoFence_FixBatch &batch)
+	{
+		if (message_class != 0x01 || message_id != 0x07 || length < 92 || !(accept & GEOFENCE_FIX_UBX_NAV_PVT))    // only NAV-PVT has a fix
+		{
+			counters.sentences++;
+			return;
+		}
+		pending.source = GEOFENCE_FIX_UBX_NAV_PVT;
+		pending.latitude = (float)(ubx_latitude * 1e-7);
+		pending.longitude = (float)(ubx_longitude * 1e-7);
+		pending.speed_mps = ubx_speed * 0.001f;
+		// UTC time of day, nano is signed and may move the time back into the previous second (or day)
+		int32_t ms = (int32_t)(((ubx_time >> 16) & 0xFF) * 3600000 + ((ubx_time >> 8) & 0xFF) * 60000 + (ubx_time & 0xFF) * 1000);
+		ms += (ubx_nano >= 0 ? ubx_nano : ubx_nano - 999999) / 1000000;
+		pending.time_of_day_ms = (uint32_t)(ms < 0 ? ms + 86400000 : ms);
+		int32_t days = -1;
+		if ((ubx_valid & 0x01) && ubx_month >= 1 && ubx_month <= 12 && ubx_day >= 1 && ubx_day <= 31)    // validDate
+			days = days_from_civil(ubx_year, ubx_month, ubx_day) - (ms < 0);
+		stamp_date(days);
+		bool fix_ok = (ubx_flags & 0x01) && ubx_fix_type >= 2 && ubx_fix_type <= 4;    // 2D, 3D or GNSS + dead reckoning
+		emit(batch, fix_ok);
+	}
+
+	/**
+	 * @brief Take the NAV-PVT fields we need out of the payload byte at offset (little endian).
+	 */
+	void read_nav_pvt_byte(uint8_t c)
+	{
+		uint16_t o = offset;
+		if (o == 4 || o == 5)
+			ubx_year = (uint16_t)(ubx_year | (c << (8 * (o - 4))));
+		else if (o == 6)
+			ubx_month = c;
+		else if (o == 7)
+			ubx_day = c;
+		else if (o >= 8 && o <= 10)
+			ubx_time = (ubx_time << 8) | c;    // hour, min, sec
+		else if (o == 11)
+			ubx_valid = c;
+		else if (o >= 16 && o < 20)
+			ubx_nano = (int32_t)((uint32_t)ubx_nano | ((uint32_t)c << (8 * (o - 16))));
+		else if (o == 20)
+			ubx_fix_type = c;
+		else if (o == 21)
+			ubx_flags = c;
+		else if (o >= 24 && o < 28)
+			ubx_longitude = (int32_t)((uint32_t)ubx_longitude | ((uint32_t)c << (8 * (o - 24))));
+		else if (o >= 28 && o < 32)
+			ubx_latitude = (int32_t)((uint32_t)ubx_latitude | ((uint32_t)c << (8 * (o - 28))));
+		else if (o >= 60 && o < 64)
+			ubx_speed = (int32_t)((uint32_t)ubx_speed | ((uint32_t)c << (8 * (o - 60))));
+	}
+
+	void ubx_checksum(uint8_t c)
+	{
+		checksum += c;
+		checksum_b += checksum;
+	}
+
+	void malformed()
+	{
+		counters.malformed++;
+		state = WAIT_SYNC;
+	}
+
+   public:
+	GeoFence_GnssCounters counters;
+
+	/**
+	 * @param sources GeoFence_FixSource flags of the messages that produce fixes, a receiver sending both RMC and GGA every epoch
+	 * would otherwise give each position twice
+	 */
+	GeoFence_GnssParser(uint8_t sources = GEOFENCE_FIX_ALL) : accept(sources) {}
+
+	void reset()
+	{
+		state = WAIT_SYNC;
+		counters = GeoFence_GnssCounters();
+		date_days = -1;
+		last_time_of_day_ms = 0;
+	}
+
+	/**
+	 * @brief Feed bytes to the parser, fixes are appended to batch. Stops right after the fix that fills the batch so the caller can
+	 * evaluate it, clear it and call again with the rest of the data.
+	 *
+	 * @return bytes consumed
+	 */
+	size_t parse(const uint8_t *data, size_t size, GeoFence_FixBatch &batch)
+	{
+		size_t k = 0;
+		while (k < size && !batch.is_full())
+		{
+			if (state == WAIT_SYNC)
+			{
+				// skipped sentences and noise, look for the next start without going through the state machine
+				while (k < size && data[k] != '$' && data[k] != 0xB5) k++;
+				if (k == size) break;
+			}
+			uint8_t c = data[k++];
+			switch (state)
+			{
+			case WAIT_SYNC:
+				if (c == '$')
+					start_nmea();
+				else if (c == 0xB5)
+					state = UBX_SYNC;
+				break;
+
+			case NMEA_ADDRESS:
+				if (c == ',')
+				{
+					checksum ^= c;
+					state = start_sentence() ? NMEA_FIELD : WAIT_SYNC;
+				}
+				else if (c == '$')
+				{
+					counters.malformed++;
+					start_nmea();
+				}
+				else if (c < 'A' || c > 'Z' || ++length > 6)
+					malformed();
+				else
+				{
+					checksum ^= c;
+					address = ((address << 8) | c) & 0xFFFFFF;
+				}
+				break;
+
+			case NMEA_FIELD:
+				if (++length > GEOFENCE_NMEA_MAX_LENGTH)
+				{
+					malformed();
+					break;
+				}
+				if (c >= '0' && c <= '9')
+				{
+					checksum ^= c;
+					if (digits < 18 && decimals < 10)    // more decimals than a float can hold are dropped
+					{
+						mantissa = mantissa * 10 + (c - '0');
+						digits++;
+						if (decimals >= 0) decimals++;
+					}
+				}
+				else if (c == ',')
+				{
+					checksum ^= c;
+					end_field();
+				}
+				else if (c == '.')
+				{
+					checksum ^= c;
+					decimals = 0;
+				}
+				else if (c == '*')
+				{
+					end_field();
+					state = NMEA_CHECKSUM_HIGH;
+				}
+				else if (c == '$')
+				{
+					counters.malformed++;
+					start_nmea();
+				}
+				else if (c < ' ' || c > '~')
+					malformed();
+				else
+				{
+					checksum ^= c;
+					letter = (char)c;
+				}
+				break;
+
+			case NMEA_CHECKSUM_HIGH:
+			case NMEA_CHECKSUM_LOW:
+			{
+				int v = hex_value(c);
+				if (v < 0)
+				{
+					malformed();
+					if (c == '$') start_nmea();
+					break;
+				}
+				if (state == NMEA_CHECKSUM_HIGH)
+				{
+					received_checksum = (uint8_t)(v << 4);
+					state = NMEA_CHECKSUM_LOW;
+					break;
+				}
+				state = WAIT_SYNC;
+				if ((received_checksum | v) != checksum)
+				{
+					counters.checksum_errors++;
+					break;
+				}
+				if (has_time) stamp_date(sentence_days);
+				emit(batch, valid && has_time && has_latitude && has_longitude);
+				break;
+			}
+
+			case UBX_SYNC:
+				if (c == 0x62)
+					state = UBX_CLASS;
+				else if (c == '$')
+					start_nmea();
+				else if (c != 0xB5)
+					state = WAIT_SYNC;
+				break;
+
+			case UBX_CLASS:
+				checksum = checksum_b = 0;
+				ubx_checksum(c);
+				message_class = c;
+				state = UBX_ID;
+				break;
+
+			case UBX_ID:
+				ubx_checksum(c);
+				message_id = c;
+				state = UBX_LENGTH_LOW;
+				break;
+
+			case UBX_LENGTH_LOW:
+				ubx_checksum(c);
+				length = c;
+				state = UBX_LENGTH_HIGH;
+				break;
+
+			case UBX_LENGTH_HIGH:
+				ubx_checksum(c);
+				length |= (uint16_t)(c << 8);
+				if (length > GEOFENCE_UBX_MAX_LENGTH)
+				{
+					malformed();
+					break;
+				}
+				offset = 0;
+				ubx_time = 0;
+				ubx_nano = ubx_longitude = ubx_latitude = ubx_speed = 0;
+				ubx_year = 0;
+				ubx_month = ubx_day = ubx_valid = ubx_fix_type = ubx_flags = 0;
+				state = length ? UBX_PAYLOAD : UBX_CHECKSUM_A;
+				break;
+
+			case UBX_PAYLOAD:
+				ubx_checksum(c);
+				if (message_class == 0x01 && message_id == 0x07) read_nav_pvt_byte(c);
+				if (++offset == length) state = UBX_CHECKSUM_A;
+				break;
+
+			case UBX_CHECKSUM_A:
+				received_checksum = c;
+				state = UBX_CHECKSUM_B;
+				break;
+
+			case UBX_CHECKSUM_B:
+				state = WAIT_SYNC;
+				if (received_checksum != checksum || c != checksum_b)
+				{
+					counters.checksum_errors++;
+					break;
+				}
+				finish_ubx(batch);
+				break;
+			}
+		}
+		return k;
+	}
+
+	/**
+	 * @brief Parse the bytes stored in ring in place, consuming what was read. Stops when the ring is empty or the batch is full.
+	 *
+	 * @return bytes consumed
+	 */
+	size_t parse(GeoFence_ByteRing &ring, GeoFence_FixBatch &batch)
+	{
+		size_t total = 0;
+		const uint8_t *data;
+		size_t available;
+		while (!batch.is_full() && (available = ring.readable(&data)) > 0)
+		{
+			size_t used = parse(data, available, batch);
+			ring.consume(used);
+			total += used;
+		}
+		return total;
+	}
+};
@@ -0,0 +1,596 @@
+/**
+ * @file geofence_overlap.h
+ * @brief Relations between fences: do they overlap, does one contain the other, how much area they share. Meant for deduplicating
+ * uploaded zones and for building a hierarchy where the children of a fence are only tested when the point is inside the parent.
+ *
+ * Fence pairs are pruned with a sweep over their bounding boxes (sorted by longitude, only boxes that overlap the sweep position are
+ * compared), then the edge blocks of each candidate pair are swept the same way so only edges in overlapping blocks are tested
+ * against each other. The geometry is the plane of GeoFence::is_inside(), longitude as x and latitude as y, areas are in square
+ * degrees. Fences are expected to be simple polygons (see geofence_validate.h), the winding doesn't matter.
+ *
+ * Usage:
+ *   std::vector<GeoFence_PairRelation> pairs;
+ *   GeoFence_Overlap::find_related_pairs(fences, pairs, true);    // every pair that isn't disjoint, with the shared area
+ *
+ *   GeoFence_Hierarchy hierarchy(fences);
+ *   hierarchy.containing(fences, p, inside);                        // children are skipped when their parent says outside
+ */
+#pragma once
+#include "geofence.h"
+
+enum GeoFence_Relation
+{
+	GEOFENCE_DISJOINT,    // no shared area, the boundaries may touch
+	GEOFENCE_OVERLAPS,    // some shared area, neither holds the other
+	GEOFENCE_CONTAINS,    // the first fence holds the second
+	GEOFENCE_WITHIN,      // the first fence is inside the second
+	GEOFENCE_EQUAL        // same area, a duplicate
+};
+
+inline const char *geofence_relation_name(GeoFence_Relation relation)
+{
+	switch (relation)
+	{
+		case GEOFENCE_DISJOINT: return "disjoint";
+		case GEOFENCE_OVERLAPS: return "overlaps";
+		case GEOFENCE_CONTAINS: return "contains";
+		case GEOFENCE_WITHIN: return "within";
+		case GEOFENCE_EQUAL: return "equal";
+	}
+	return "unknown";
+}
+
+/**
+ * @brief A pair of fences of a set that aren't disjoint, see GeoFence_Overlap::find_related_pairs().
+ */
+class GeoFence_PairRelation
+{
+   public:
+	size_t first;
+	size_t second;
+	GeoFence_Relation relation;       // of first to second
+	double overlap_area_degrees;      // 0 unless the area was asked for
+
+	GeoFence_PairRelation(size_t a, size_t b, GeoFence_Relation r, double area) : first(a), second(b), relation(r), overlap_area_degrees(area) {}
+};
+
+#ifndef GEOFENCE_OVERLAP_AREA_TOLERANCE
+#define GEOFENCE_OVERLAP_AREA_TOLERANCE 1e-6    // relative, an overlap this close to a fence's area counts as the whole fence
+#endif
+
+class GeoFence_Overlap
+{
+   private:
+	struct EdgeCut
+	{
+		size_t edge;
+		double t;         // 0 at the edge start, 1 at its end
+		bool crossing;    // the boundaries cross here, false when they only touch (a vertex on an edge, shared edges)
+
+		bool operator<(const EdgeCut &other) const { return edge != other.edge ? edge < other.edge : t < other.t; }
+	};
+
+	/**
+	 * @brief Part of an edge lying on an edge of the other fence.
+	 */
+	struct EdgeShared
+	{
+		size_t edge;
+		double t0, t1;
+		bool same_direction;
+
+		bool operator<(const EdgeShared &other) const { return edge < other.edge; }
+	};
+
+	struct Contacts
+	{
+		bool crossing = false;    // the boundaries cross, so both fences have area outside the other
+		bool touching = false;    // any contact at all
+		std::vector<EdgeCut> cuts_a, cuts_b;
+		std::vector<EdgeShared> shared_a, shared_b;
+	};
+
+	static double cross(double ax, double ay, double bx, double by) { return ax * by - ay * bx; }
+
+	static GeoFence_BoundingBox intersection(const GeoFence_BoundingBox &a, const GeoFence_BoundingBox &b)
+	{
+		GeoFence_BoundingBox box;
+		box.min_latitude = std::max(a.min_latitude, b.min_latitude);
+		box.max_latitude = std::min(a.max_latitude, b.max_latitude);
+		box.min_longitude = std::max(a.min_longitude, b.min_longitude);
+		box.max_longitude = std::min(a.max_longitude, b.max_longitude);
+		return box;
+	}
+
+	/**
+	 * @brief Bounding box of a fence, also right when its index is stale.
+	 */
+	static GeoFence_BoundingBox fence_box(const GeoFence &fence)
+	{
+		if (fence.is_index_current()) return fence.bounding_box();
+		GeoFence_BoundingBox box;
+		for (const GPS_Coordinate &c : fence.boundary_coordinates) box.expand(c);
+		return box;
+	}
+
+	/**
+	 * @brief The edge blocks of a fence that reach into clip. A fence whose index is stale gets one block over every edge.
+	 */
+	static void collect_blocks(const GeoFence &fence, const GeoFence_BoundingBox &clip, std::vector<GeoFence_EdgeBlock> &blocks)
+	{
+		blocks.clear();
+		if (!fence.is_index_current())
+		{
+			GeoFence_EdgeBlock all(0, fence.boundary_coordinates.size());
+			for (const GPS_Coordinate &c : fence.boundary_coordinates) all.bounds.expand(c);
+			if (all.bounds.overlaps(clip)) blocks.push_back(all);
+			return;
+		}
+		for (const GeoFence_EdgeBlock &block : fence.get_edge_blocks())
+		{
+			if (block.bounds.overlaps(clip)) blocks.push_back(block);
+		}
+	}
+
+	/**
+	 * @brief Test every edge of block_a against every edge of block_b and record where they meet.
+	 */
+	static void meet_blocks(const GeoFence &a, const GeoFence_EdgeBlock &block_a, const GeoFence &b, const GeoFence_EdgeBlock &block_b,
+	                        Contacts &contacts)
+	{
+		const std::vector<GPS_Coordinate> &va = a.boundary_coordinates, &vb = b.boundary_coordinates;
+		size_t na = va.size(), nb = vb.size();
+		for (size_t ea = block_a.first_edge; ea < block_a.first_edge + block_a.edge_count; ea++)
+		{
+			const GPS_Coordinate &p0 = va[ea], &p1 = va[(ea + 1) % na];
+			GeoFence_BoundingBox edge_box;
+			edge_box.expand(p0);
+			edge_box.expand(p1);
+			if (!edge_box.overlaps(block_b.bounds)) continue;
+			double rx = (double)p1.longitude - p0.longitude, ry = (double)p1.latitude - p0.latitude;
+
+			for (size_t eb = block_b.first_edge; eb < block_b.first_edge + block_b.edge_count; eb++)
+			{
+				const GPS_Coordinate &q0 = vb[eb], &q1 = vb[(eb + 1) % nb];
+				if (std::max(q0.latitude, q1.latitude) < edge_box.min_latitude || std::min(q0.latitude, q1.latitude) > edge_box.max_latitude ||
+				    std::max(q0.longitude, q1.longitude) < edge_box.min_longitude ||
+				    std::min(q0.longitude, q1.longitude) > edge_box.max_longitude)
+					continue;
+				double sx = (double)q1.longitude - q0.longitude, sy = (double)q1.latitude - q0.latitude;
+				double qx = (double)q0.longitude - p0.longitude, qy = (double)q0.latitude - p0.latitude;
+				double denominator = cross(rx, ry, sx, sy);
+				if (denominator != 0)
+				{
+					double t = cross(qx, qy, sx, sy) / denominator;
+					double u = cross(qx, qy, rx, ry) / denominator;
+					if (t < 0 || t > 1 || u < 0 || u > 1) continue;
+					contacts.touching = true;
+					bool crossing = t > 0 && t < 1 && u > 0 && u < 1;
+					contacts.crossing = contacts.crossing || crossing;
+					contacts.cuts_a.push_back({ea, t, crossing});
+					contacts.cuts_b.push_back({eb, u, crossing});
+				}
+				else if (cross(qx, qy, rx, ry) == 0)
+				{
+					// collinear, keep the part of each edge that lies on the other
+					double rr = rx * rx + ry * ry, ss = sx * sx + sy * sy;
+					if (rr == 0 || ss == 0) continue;
+					double t0 = (qx * rx + qy * ry) / rr, t1 = ((qx + sx) * rx + (qy + sy) * ry) / rr;
+					double u0 = (-qx * sx - qy * sy) / ss, u1 = ((rx - qx) * sx + (ry - qy) * sy) / ss;
+					double a_from = std::max(0.0, std::min(t0, t1)), a_to = std::min(1.0, std::max(t0, t1));
+					double b_from = std::max(0.0, std::min(u0, u1)), b_to = std::min(1.0, std::max(u0, u1));
+					if (a_from > a_to) continue;
+					contacts.touching = true;
+					bool same_direction = rx * sx + ry * sy > 0;
+					if (a_from < a_to) contacts.shared_a.push_back({ea, a_from, a_to, same_direction});
+					if (b_from < b_to) contacts.shared_b.push_back({eb, b_from, b_to, same_direction});
+					contacts.cuts_a.push_back({ea, a_from, false});
+					contacts.cuts_a.push_back({ea, a_to, false});
+					contacts.cuts_b.push_back({eb, b_from, false});
+					contacts.cuts_b.push_back({eb, b_to, false});
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Ray cast like GeoFence::is_inside() but for a point in doubles, the pieces of an edge between two contacts can be shorter
+	 * than the float rounding of their middle point. Only the blocks that straddle the latitude are tested.
+	 */
+	static bool contains_point(const GeoFence &fence, double x, double y)
+	{
+		const std::vector<GPS_Coordinate> &v = fence.boundary_coordinates;
+		size_t n = v.size();
+		bool inside = false;
+		auto test_edges = [&](size_t first, size_t count)
+		{
+			for (size_t e = first; e < first + count; e++)
+			{
+				const GPS_Coordinate &a = v[e], &b = v[(e + 1) % n];
+				if ((a.latitude > y) == (b.latitude > y)) continue;
+				double crossing_x = a.longitude + (y - a.latitude) * ((double)b.longitude - a.longitude) / ((double)b.latitude - a.latitude);
+				if (x < crossing_x) inside = !inside;
+			}
+		};
+		if (!fence.is_index_current())
+		{
+			test_edges(0, n);
+			return inside;
+		}
+		for (const GeoFence_EdgeBlock &block : fence.get_edge_blocks())
+		{
+			if (y < block.bounds.min_latitude || y > block.bounds.max_latitude) continue;
+			test_edges(block.first_edge, block.edge_count);
+		}
+		return inside;
+	}
+
+	struct SweepBlock
+	{
+		float min_longitude;
+		int fence;    // 0 for a, 1 for b
+		size_t block;
+
+		bool operator<(const SweepBlock &other) const { return min_longitude < other.min_longitude; }
+	};
+
+	/**
+	 * @brief Sweep the edge blocks of both fences by longitude, blocks of a are only tested against the blocks of b that overlap them.
+	 *
+	 * @param stop_at_crossing return as soon as the boundaries are known to cross (no cuts needed)
+	 */
+	static void find_contacts(const GeoFence &a, const std::vector<GeoFence_EdgeBlock> &blocks_a, const GeoFence &b,
+	                          const std::vector<GeoFence_EdgeBlock> &blocks_b, Contacts &contacts, bool stop_at_crossing)
+	{
+		std::vector<SweepBlock> order;
+		order.reserve(blocks_a.size() + blocks_b.size());
+		for (size_t k = 0; k < blocks_a.size(); k++) order.push_back({blocks_a[k].bounds.min_longitude, 0, k});
+		for (size_t k = 0; k < blocks_b.size(); k++) order.push_back({blocks_b[k].bounds.min_longitude, 1, k});
+		std::sort(order.begin(), order.end());
+
+		std::vector<size_t> active[2];
+		const std::vector<GeoFence_EdgeBlock> *blocks[2] = {&blocks_a, &blocks_b};
+		for (const SweepBlock &current : order)
+		{
+			const GeoFence_EdgeBlock &block = (*blocks[current.fence])[current.block];
+			std::vector<size_t> &others = active[1 - current.fence];
+			const std::vector<GeoFence_EdgeBlock> &other_blocks = *blocks[1 - current.fence];
+			size_t kept = 0;
+			for (size_t k = 0; k < others.size(); k++)
+			{
+				const GeoFence_EdgeBlock &other = other_blocks[others[k]];
+				if (other.bounds.max_longitude < block.bounds.min_longitude) continue;    // the sweep has passed it
+				others[kept++] = others[k];
+				if (!other.bounds.overlaps(block.bounds)) continue;
+				if (current.fence == 0)
+					meet_blocks(a, block, b, other, contacts);
+				else
+					meet_blocks(a, other, b, block, contacts);
+				if (stop_at_crossing && contacts.crossing) return;
+			}
+			others.resize(kept);
+			active[current.fence].push_back(current.block);
+		}
+	}
+
+	/**
+	 * @brief Twice the area that the parts of fence's boundary inside other add to the shoelace sum of the overlap (Green's theorem:
+	 * the overlap is bounded by the parts of each boundary that are inside the other fence). Parts running along the other boundary
+	 * are counted once, by the first fence, and only when both go the same way once both are wound counterclockwise (the fences are
+	 * on the same side of it).
+	 *
+	 * Whether a piece is inside is carried along the boundary: it flips at every crossing and is outside after edges skipped for lying
+	 * outside the other fence's box. Only after a touch (or at the start) is a point tested, so the cost stays near linear even when
+	 * every ray cast would cross thousands of edges.
+	 */
+	static double boundary_inside_area(const GeoFence &fence, const std::vector<GeoFence_EdgeBlock> &blocks, const GeoFence &other,
+	                                   std::vector<EdgeCut> &cuts, std::vector<EdgeShared> &shared, bool count_shared, double origin_x,
+	                                   double origin_y)
+	{
+		std::sort(cuts.begin(), cuts.end());
+		std::sort(shared.begin(), shared.end());
+		const std::vector<GPS_Coordinate> &v = fence.boundary_coordinates;
+		size_t n = v.size();
+		double sign = signed_area(fence) < 0 ? -1 : 1;    // clockwise boundaries are walked backwards
+		bool same_winding = (sign < 0) == (signed_area(other) < 0);
+		double twice_area = 0;
+		size_t next_cut = 0, next_shared = 0;
+		int state = -1;    // of the boundary at the current position: 1 inside other, 0 outside, -1 not known
+		size_t previous_edge = n;
+		for (const GeoFence_EdgeBlock &block : blocks)
+		{
+			for (size_t e = block.first_edge; e < block.first_edge + block.edge_count; e++)
+			{
+				if (previous_edge != n && e != previous_edge + 1) state = 0;    // the edges in between are outside other's box
+				previous_edge = e;
+				while (next_cut < cuts.size() && cuts[next_cut].edge < e) next_cut++;
+				while (next_shared < shared.size() && shared[next_shared].edge < e) next_shared++;
+
+				const GPS_Coordinate &p0 = v[e], &p1 = v[(e + 1) % n];
+				double x0 = (double)p0.longitude - origin_x, y0 = (double)p0.latitude - origin_y;
+				double dx = (double)p1.longitude - p0.longitude, dy = (double)p1.latitude - p0.latitude;
+				double from = 0;
+				while (true)
+				{
+					// next position where something happens along the edge, several contacts at the same place count as a touch
+					double to = 1;
+					bool at_cut = next_cut < cuts.size() && cuts[next_cut].edge == e;
+					if (at_cut) to = cuts[next_cut].t;
+					if (to > from)
+					{
+						double middle = (from + to) / 2;
+						bool on_boundary = false, inside = false;
+						for (size_t s = next_shared; s < shared.size() && shared[s].edge == e; s++)
+						{
+							if (middle < shared[s].t0 || middle > shared[s].t1) continue;
+							on_boundary = true;
+							inside = inside || (count_shared && shared[s].same_direction == same_winding);
+						}
+						if (!on_boundary)
+						{
+							if (state < 0) state = contains_point(other, p0.longitude + middle * dx, p0.latitude + middle * dy);
+							inside = state == 1;
+						}
+						else
+						{
+							state = -1;
+						}
+						if (inside) twice_area += sign * cross(x0 + from * dx, y0 + from * dy, x0 + to * dx, y0 + to * dy);
+						from = to;
+					}
+					if (!at_cut) break;
+
+					size_t contacts_here = 0;
+					bool crossing = true;
+					for (; next_cut < cuts.size() && cuts[next_cut].edge == e && cuts[next_cut].t == to; next_cut++)
+					{
+						contacts_here++;
+						crossing = crossing && cuts[next_cut].crossing;
+					}
+					if (crossing && contacts_here == 1 && state >= 0)
+						state = 1 - state;
+					else
+						state = -1;
+				}
+			}
+		}
+		return twice_area;
+	}
+
+	static double signed_area(const GeoFence &fence) { return signed_area_of(fence); }
+
+   public:
+	/**
+	 * @brief Signed area in square degrees, like GeoFence::signed_area_degrees() but also right when the index is stale.
+	 */
+	static double signed_area_of(const GeoFence &fence)
+	{
+		if (fence.is_index_current()) return fence.signed_area_degrees();
+		const std::vector<GPS_Coordinate> &v = fence.boundary_coordinates;
+		double twice_area = 0;
+		for (size_t k = 0; k < v.size(); k++)
+		{
+			const GPS_Coordinate &a = v[k], &b = v[(k + 1) % v.size()];
+			twice_area += (double)a.longitude * b.latitude - (double)b.longitude * a.latitude;
+		}
+		return twice_area / 2;
+	}
+
+   private:
+	static double overlap_area(const GeoFence &a, const std::vector<GeoFence_EdgeBlock> &blocks_a, const GeoFence &b,
+	                           const std::vector<GeoFence_EdgeBlock> &blocks_b, Contacts &contacts)
+	{
+		GeoFence_BoundingBox box = fence_box(a);
+		double origin_x = box.min_longitude, origin_y = box.min_latitude;    // keeps the shoelace terms small
+		double twice_area = boundary_inside_area(a, blocks_a, b, contacts.cuts_a, contacts.shared_a, true, origin_x, origin_y) +
+		                    boundary_inside_area(b, blocks_b, a, contacts.cuts_b, contacts.shared_b, false, origin_x, origin_y);
+		return std::max(0.0, twice_area / 2);
+	}
+
+	static bool close_to(double area, double reference)
+	{
+		return fabs(area - reference) <= GEOFENCE_OVERLAP_AREA_TOLERANCE * fabs(reference);
+	}
+
+   public:
+	/**
+	 * @brief Fences whose bounding boxes overlap, found by sweeping the boxes by longitude. Calls found(i, j) with i < j. Each box is
+	 * only compared with the boxes still open at its longitude, so for spread out fences the cost is the sort plus the pairs found
+	 * rather than all N^2 pairs. find_related_pairs() relates exactly these pairs.
+	 */
+	template <typename Found>
+	static void sweep_fence_boxes(const std::vector<GeoFence> &fences, Found found)
+	{
+		std::vector<GeoFence_BoundingBox> boxes;
+		std::vector<size_t> order;
+		for (size_t k = 0; k < fences.size(); k++)
+		{
+			boxes.push_back(fence_box(fences[k]));
+			if (!boxes[k].is_empty()) order.push_back(k);
+		}
+		std::sort(order.begin(), order.end(), [&boxes](size_t x, size_t y) { return boxes[x].min_longitude < boxes[y].min_longitude; });
+		std::vector<size_t> active;
+		for (size_t current : order)
+		{
+			const GeoFence_BoundingBox &box = boxes[current];
+			size_t kept = 0;
+			for (size_t k = 0; k < active.size(); k++)
+			{
+				const GeoFence_BoundingBox &other = boxes[active[k]];
+				if (other.max_longitude < box.min_longitude) continue;
+				active[kept++] = active[k];
+				if (other.overlaps(box)) found(std::min(current, active[k]), std::max(current, active[k]));
+			}
+			active.resize(kept);
+			active.push_back(current);
+		}
+	}
+
+	/**
+	 * @brief True when the boundaries of the two fences cross or touch anywhere.
+	 */
+	static bool boundaries_touch(const GeoFence &a, const GeoFence &b)
+	{
+		GeoFence_BoundingBox clip = intersection(fence_box(a), fence_box(b));
+		if (clip.is_empty() || clip.min_longitude > clip.max_longitude) return false;
+		std::vector<GeoFence_EdgeBlock> blocks_a, blocks_b;
+		collect_blocks(a, clip, blocks_a);
+		collect_blocks(b, clip, blocks_b);
+		Contacts contacts;
+		find_contacts(a, blocks_a, b, blocks_b, contacts, true);
+		return contacts.touching;
+	}
+
+	/**
+	 * @brief Area shared by the two fences in square degrees (longitude x latitude, multiply by about 111.32 km squared and the cosine
+	 * of the latitude for square meters).
+	 */
+	static double overlap_area_degrees(const GeoFence &a, const GeoFence &b)
+	{
+		GeoFence_BoundingBox clip = intersection(fence_box(a), fence_box(b));
+		if (clip.is_empty() || clip.min_longitude > clip.max_longitude) return 0;
+		std::vector<GeoFence_EdgeBlock> blocks_a, blocks_b;
+		collect_blocks(a, clip, blocks_a);
+		collect_blocks(b, clip, blocks_b);
+		Contacts contacts;
+		find_contacts(a, blocks_a, b, blocks_b, contacts, false);
+		return overlap_area(a, blocks_a, b, blocks_b, contacts);
+	}
+
+	/**
+	 * @brief How fence a relates to fence b. The shared area is only computed when it is asked for or when the boundaries touch
+	 * without crossing (shared edges, a vertex on the other boundary), the other cases are settled by the edge test and one
+	 * is_inside() call.
+	 *
+	 * @param overlap_area set to the shared area in square degrees when not null
+	 */
+	static GeoFence_Relation relate(const GeoFence &a, const GeoFence &b, double *overlap_area_out = nullptr)
+	{
+		if (overlap_area_out) *overlap_area_out = 0;
+		if (a.boundary_coordinates.size() < 3 || b.boundary_coordinates.size() < 3) return GEOFENCE_DISJOINT;
+		GeoFence_BoundingBox clip = intersection(fence_box(a), fence_box(b));
+		if (clip.is_empty() || clip.min_longitude > clip.max_longitude) return GEOFENCE_DISJOINT;
+
+		std::vector<GeoFence_EdgeBlock> blocks_a, blocks_b;
+		collect_blocks(a, clip, blocks_a);
+		collect_blocks(b, clip, blocks_b);
+		Contacts contacts;
+		find_contacts(a, blocks_a, b, blocks_b, contacts, overlap_area_out == nullptr);
+
+		if (!contacts.touching)
+		{
+			// no contact at all: one fence is inside the other or they are apart, any vertex tells which
+			if (b.is_inside(a.boundary_coordinates[0]))
+			{
+				if (overlap_area_out) *overlap_area_out = fabs(signed_area(a));
+				return GEOFENCE_WITHIN;
+			}
+			if (a.is_inside(b.boundary_coordinates[0]))
+			{
+				if (overlap_area_out) *overlap_area_out = fabs(signed_area(b));
+				return GEOFENCE_CONTAINS;
+			}
+			return GEOFENCE_DISJOINT;
+		}
+		if (contacts.crossing && !overlap_area_out) return GEOFENCE_OVERLAPS;
+
+		double area = overlap_area(a, blocks_a, b, blocks_b, contacts);
+		if (overlap_area_out) *overlap_area_out = area;
+		if (contacts.crossing) return GEOFENCE_OVERLAPS;
+		double area_a = fabs(signed_area(a)), area_b = fabs(signed_area(b));
+		bool all_of_a = close_to(area, area_a), all_of_b = close_to(area, area_b);
+		if (all_of_a && all_of_b) return GEOFENCE_EQUAL;
+		if (all_of_a) return GEOFENCE_WITHIN;
+		if (all_of_b) return GEOFENCE_CONTAINS;
+		if (area <= GEOFENCE_OVERLAP_AREA_TOLERANCE * std::min(area_a, area_b)) return GEOFENCE_DISJOINT;
+		return GEOFENCE_OVERLAPS;
+	}
+
+	/**
+	 * @brief Every pair of fences in the set that isn't disjoint. Only pairs whose bounding boxes overlap are related, and those are
+	 * found by a sweep over the boxes instead of comparing all N^2 pairs.
+	 *
+	 * @param pairs cleared, then filled with (first < second) pairs and the relation of first to second
+	 * @param with_area also compute the shared area of each pair (slower for crossing fences)
+	 * @return number of pairs found
+	 */
+	static size_t find_related_pairs(const std::vector<GeoFence> &fences, std::vector<GeoFence_PairRelation> &pairs, bool with_area = false)
+	{
+		pairs.clear();
+		sweep_fence_boxes(fences,
+		                  [&](size_t i, size_t j)
+		                  {
+			                  double area = 0;
+			                  GeoFence_Relation relation = relate(fences[i], fences[j], with_area ? &area : nullptr);
+			                  if (relation != GEOFENCE_DISJOINT) pairs.emplace_back(i, j, relation, area);
+		                  });
+		std::sort(pairs.begin(), pairs.end(), [](const GeoFence_PairRelation &x, const GeoFence_PairRelation &y)
+		          { return x.first != y.first ? x.first < y.first : x.second < y.second; });
+		return pairs.size();
+	}
+};
+
+/**
+ * @brief Nesting of a fence set: the parent of a fence is the smallest fence that contains it (the first one of a group of equal
+ * fences holds the others), so a point outside a parent is outside all its children too.
+ */
+class GeoFence_Hierarchy
+{
+   public:
+	std::vector<int> parent;                      // -1 for top level fences
+	std::vector<std::vector<size_t>> children;
+	std::vector<size_t> roots;
+
+	GeoFence_Hierarchy() {}
+	GeoFence_Hierarchy(const std::vector<GeoFence> &fences) { build(fences); }
+
+	void build(const std::vector<GeoFence> &fences)
+	{
+		size_t n = fences.size();
+		parent.assign(n, -1);
+		children.assign(n, std::vector<size_t>());
+		roots.clear();
+		std::vector<double> parent_area(n, 0);
+		std::vector<GeoFence_PairRelation> pairs;
+		GeoFence_Overlap::find_related_pairs(fences, pairs);
+		for (const GeoFence_PairRelation &pair : pairs)
+		{
+			size_t outer = pair.first, inner = pair.second;
+			if (pair.relation == GEOFENCE_WITHIN) std::swap(outer, inner);
+			else if (pair.relation != GEOFENCE_CONTAINS && pair.relation != GEOFENCE_EQUAL) continue;
+			double area = fabs(GeoFence_Overlap::signed_area_of(fences[outer]));
+			if (parent[inner] < 0 || area < parent_area[inner])
+			{
+				parent[inner] = (int)outer;
+				parent_area[inner] = area;
+			}
+		}
+		for (size_t k = 0; k < n; k++)
+		{
+			if (parent[k] < 0)
+				roots.push_back(k);
+			else
+				children[parent[k]].push_back(k);
+		}
+	}
+
+	/**
+	 * @brief Indexes of the fences holding the point, a fence's children are only tested when the point is inside it.
+	 *
+	 * @return number of fences found
+	 */
+	size_t containing(const std::vector<GeoFence> &fences, const GPS_Coordinate &p, std::vector<size_t> &inside) const
+	{
+		inside.clear();
+		std::vector<size_t> pending(roots.rbegin(), roots.rend());
+		while (!pending.empty())
+		{
+			size_t k = pending.back();
+			pending.pop_back();
+			if (!fences[k].is_inside(p)) continue;
+			inside.push_back(k);
+			pending.insert(pending.end(), children[k].rbegin(), children[k].rend());
+		}
+		return inside.size();
+	}
+};
@@ -0,0 +1,261 @@
+/**
+ * @file geofence_snapshot.h
+ * @brief Versioned fence sets that can be reloaded while other threads keep querying them.
+ *
+ * Readers take the current GeoFence_Set with one atomic load and never wait on a reload. Writers build the next set on their own
+ * thread and publish it, the old set is deleted once no reader can still be using it (epoch based reclamation, like RCU).
+ *
+ * Retired sets are only freed by the writer, in the next publish() or reclaim(), never when a reader releases its guard (that would put
+ * the writer mutex on the read path). After the last reload the previous set stays in memory until one of them runs, so a writer that
+ * reloads rarely should call reclaim() once the readers have moved on.
+ *
+ * Usage:
+ *   GeoFence_SnapshotStore store;
+ *   store.publish(new GeoFence_Set(...));            // writer, takes ownership
+ *
+ *   GeoFence_SnapshotReader reader(store);            // once per reader thread
+ *   {
+ *       GeoFence_ReadGuard guard(reader);
+ *       bool inside = guard->fences[0].is_inside(p);  // set stays alive until the guard goes out of scope
+ *   }
+ *   store.reclaim();                                  // writer, frees the sets retired by earlier publish() calls
+ */
+#pragma once
+#include "geofence.h"
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+
+#ifndef GEOFENCE_SNAPSHOT_MAX_READERS
+#define GEOFENCE_SNAPSHOT_MAX_READERS 64    // reader threads that can be registered on one store at the same time
+#endif
+
+/**
+ * @brief An immutable group of fences, published as a whole by GeoFence_SnapshotStore.
+ */
+class GeoFence_Set
+{
+   public:
+	std::vector<GeoFence> fences;
+	uint32_t version = 0;    // set by GeoFence_SnapshotStore::publish()
+
+	GeoFence_Set() {}
+	GeoFence_Set(const std::vector<GeoFence> &fence_list) : fences(fence_list) {}
+
+	/**
+	 * @brief Index of the first fence that contains the point, or -1 when it is outside all of them.
+	 */
+	int first_containing(const GPS_Coordinate &p) const
+	{
+		for (size_t i = 0; i < fences.size(); i++)
+		{
+			if (fences[i].is_inside(p)) return (int)i;
+		}
+		return -1;
+	}
+};
+
+class GeoFence_SnapshotStore
+{
+   private:
+	struct RetiredSet
+	{
+		const GeoFence_Set *set;
+		uint32_t retire_epoch;    // readers that announced an older epoch may still hold the set
+	};
+
+	std::atomic<const GeoFence_Set *> current{nullptr};
+	std::atomic<uint32_t> global_epoch{1};
+	std::atomic<uint32_t> reader_epochs[GEOFENCE_SNAPSHOT_MAX_READERS];    // 0 when the reader is not inside a read section
+	std::atomic<bool> reader_slots_used[GEOFENCE_SNAPSHOT_MAX_READERS];
+	std::mutex writer_mutex;    // serializes writers only, readers never touch it
+	std::vector<RetiredSet> retired;
+	uint32_t next_version = 1;
+
+	bool is_reclaimable(uint32_t retire_epoch) const
+	{
+		for (int i = 0; i < GEOFENCE_SNAPSHOT_MAX_READERS; i++)
+		{
+			uint32_t e = reader_epochs[i].load();
+			if (e != 0 && e < retire_epoch) return false;
+		}
+		return true;
+	}
+
+	size_t reclaim_locked()
+	{
+		size_t freed = 0;
+		for (size_t i = 0; i < retired.size();)
+		{
+			if (is_reclaimable(retired[i].retire_epoch))
+			{
+				delete retired[i].set;
+				retired[i] = retired.back();
+				retired.pop_back();
+				freed++;
+			}
+			else
+			{
+				i++;
+			}
+		}
+		return freed;
+	}
+
+   public:
+	GeoFence_SnapshotStore()
+	{
+		for (int i = 0; i < GEOFENCE_SNAPSHOT_MAX_READERS; i++)
+		{
+			reader_epochs[i].store(0);
+			reader_slots_used[i].store(false);
+		}
+	}
+
+	GeoFence_SnapshotStore(const GeoFence_SnapshotStore &) = delete;
+	GeoFence_SnapshotStore &operator=(const GeoFence_SnapshotStore &) = delete;
+
+	/**
+	 * @brief Deletes every set, all readers must be gone by now.
+	 */
+	~GeoFence_SnapshotStore()
+	{
+		delete current.load();
+		for (auto &r : retired) delete r.set;
+	}
+
+	/**
+	 * @brief Make a new set visible to readers. The store takes ownership of next, the previous set is retired and deleted by the first
+	 * publish() or reclaim() after the last reader that may see it leaves. The edge index of every fence is brought up to date here so
+	 * readers never write to the fences.
+	 *
+	 * @param next set allocated with new, built off the reader threads
+	 * @return version number given to the set
+	 */
+	uint32_t publish(GeoFence_Set *next)
+	{
+		for (auto &fence : next->fences)
+		{
+			if (!fence.is_index_current()) fence.rebuild_index();
+		}
+
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		next->version = next_version++;
+		const GeoFence_Set *previous = current.exchange(next);
+		uint32_t retire_epoch = global_epoch.fetch_add(1) + 1;
+		if (previous != nullptr) retired.push_back({previous, retire_epoch});
+		reclaim_locked();
+		return next->version;
+	}
+
+	/**
+	 * @brief Delete the retired sets no reader can see anymore, publish() already does this, call it to free memory
+	 * between reloads, readers never free sets themselves.
+	 *
+	 * @return number of sets deleted
+	 */
+	size_t reclaim()
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		return reclaim_locked();
+	}
+
+	/**
+	 * @brief Number of sets waiting for readers to leave.
+	 */
+	size_t retired_count()
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		return retired.size();
+	}
+
+	/**
+	 * @brief Claim a reader slot, returns -1 when GEOFENCE_SNAPSHOT_MAX_READERS are already registered.
+	 */
+	int register_reader()
+	{
+		for (int i = 0; i < GEOFENCE_SNAPSHOT_MAX_READERS; i++)
+		{
+			bool expected = false;
+			if (reader_slots_used[i].compare_exchange_strong(expected, true)) return i;
+		}
+		return -1;
+	}
+
+	void unregister_reader(int slot)
+	{
+		if (slot < 0) return;
+		reader_epochs[slot].store(0);
+		reader_slots_used[slot].store(false);
+	}
+
+	/**
+	 * @brief Start a read section, the returned set (nullptr before the first publish) stays valid until read_end().
+	 */
+	const GeoFence_Set *read_begin(int slot)
+	{
+		reader_epochs[slot].store(global_epoch.load());
+		return current.load();
+	}
+
+	void read_end(int slot) { reader_epochs[slot].store(0); }
+};
+
+/**
+ * @brief Registers a reader slot for the lifetime of the object, keep one per reader thread. Read sections can nest, the inner ones get
+ * the set of the outermost and only leaving the outermost one ends the read section.
+ */
+class GeoFence_SnapshotReader
+{
+   private:
+	GeoFence_SnapshotStore &store;
+	int slot;
+	int depth = 0;                         // nested acquire() calls, only touched by the owning thread
+	const GeoFence_Set *held = nullptr;    // set of the outermost read section
+
+   public:
+	GeoFence_SnapshotReader(GeoFence_SnapshotStore &s) : store(s), slot(s.register_reader()) {}
+	~GeoFence_SnapshotReader() { store.unregister_reader(slot); }
+
+	GeoFence_SnapshotReader(const GeoFence_SnapshotReader &) = delete;
+	GeoFence_SnapshotReader &operator=(const GeoFence_SnapshotReader &) = delete;
+
+	bool is_registered() const { return slot >= 0; }
+	const GeoFence_Set *acquire()
+	{
+		if (slot < 0) return nullptr;
+		if (depth++ == 0) held = store.read_begin(slot);
+		return held;
+	}
+
+	void release()
+	{
+		if (slot < 0 || depth == 0) return;
+		if (--depth == 0)
+		{
+			store.read_end(slot);
+			held = nullptr;
+		}
+	}
+};
+
+/**
+ * @brief Scoped read section, the set it points to can't be deleted while the guard is alive.
+ */
+class GeoFence_ReadGuard
+{
+   private:
+	GeoFence_SnapshotReader &reader;
+	const GeoFence_Set *set;
+
+   public:
+	GeoFence_ReadGuard(GeoFence_SnapshotReader &r) : reader(r), set(r.acquire()) {}
+	~GeoFence_ReadGuard() { reader.release(); }
+
+	GeoFence_ReadGuard(const GeoFence_ReadGuard &) = delete;
+	GeoFence_ReadGuard &operator=(const GeoFence_ReadGuard &) = delete;
+
+	const GeoFence_Set *get() const { return set; }
+	const GeoFence_Set *operator->() const { return set; }
+	explicit operator bool() const { return set != nullptr; }
+};
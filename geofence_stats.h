@@ -0,0 +1,188 @@
+/**
+ * @file geofence_stats.h
+ * @brief Opt-in query statistics for GeoFence, build with -DGEOFENCE_ENABLE_STATS to turn them on. When the flag is not defined the
+ * counters are not even members of GeoFence and the hooks in the queries compile to nothing.
+ *
+ * With the flag, every fence counts calls, edges tested, early rejections and a log2 latency histogram for is_inside() and
+ * distance_to_boundary(). The counters are relaxed atomics so concurrent readers (see geofence_snapshot.h) can share a fence.
+ *
+ * edges_tested only counts the edges of the blocks a query actually scanned, the blocks pruned by their bounding box are counted in
+ * blocks_skipped instead. The monotone chain search of is_inside() counts its 2 edges. So edges_tested equals the number of vertices
+ * only for the full scan (stale index, or a fence with a single edge block).
+ */
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+#ifndef GEOFENCE_STATS_HISTOGRAM_BUCKETS
+#define GEOFENCE_STATS_HISTOGRAM_BUCKETS 24    // bucket k counts calls that took [2^k, 2^(k+1)) ns, the last one everything slower
+#endif
+
+// total_time is kept in this unit. With 32 bit counters a sum in ns would wrap after 4.3 s of query time, in us it lasts 71 minutes
+// (the esp32 timer only has us resolution anyway). Call reset_stats() per reporting window on long running devices.
+#if defined(ESP32) || defined(ARDUINO)
+typedef uint32_t geofence_stats_counter_t;    // 64 bit atomics are emulated with locks on the microcontrollers
+#define GEOFENCE_STATS_TIME_UNIT_NS 1000
+#else
+typedef uint64_t geofence_stats_counter_t;
+#define GEOFENCE_STATS_TIME_UNIT_NS 1
+#endif
+
+/**
+ * @brief Plain snapshot of the counters of one query type.
+ */
+class GeoFence_OperationStats
+{
+   public:
+	geofence_stats_counter_t calls = 0;
+	geofence_stats_counter_t edges_tested = 0;
+	geofence_stats_counter_t early_rejections = 0;    // calls answered by the fence bounding box alone
+	geofence_stats_counter_t blocks_scanned = 0;
+	geofence_stats_counter_t blocks_skipped = 0;    // edge blocks skipped by their bounding box
+	geofence_stats_counter_t total_time = 0;    // in GEOFENCE_STATS_TIME_UNIT_NS
+	geofence_stats_counter_t latency_histogram[GEOFENCE_STATS_HISTOGRAM_BUCKETS] = {};
+
+	double early_rejection_rate() const { return calls ? (double)early_rejections / calls : 0; }
+	double mean_edges_tested() const { return calls ? (double)edges_tested / calls : 0; }
+	double mean_ns() const { return calls ? (double)total_time * GEOFENCE_STATS_TIME_UNIT_NS / calls : 0; }
+
+	/**
+	 * @brief Latency below which the given fraction (0-1) of calls finished, upper bound of the histogram bucket.
+	 */
+	double latency_percentile_ns(double fraction) const
+	{
+		geofence_stats_counter_t target = (geofence_stats_counter_t)(fraction * calls);
+		geofence_stats_counter_t seen = 0;
+		for (int k = 0; k < GEOFENCE_STATS_HISTOGRAM_BUCKETS; k++)
+		{
+			seen += latency_histogram[k];
+			if (seen > target || (seen == calls && calls)) return (double)(2ULL << k);
+		}
+		return 0;
+	}
+
+	void print(const char *operation) const
+	{
+		printf("\t%s: %llu calls, %.1f edges/call, %.1f%% early rejections, %llu blocks scanned, %llu skipped, mean %.0f ns, p50 < %.0f ns, "
+		       "p99 < %.0f ns\n",
+		       operation, (unsigned long long)calls, mean_edges_tested(), 100 * early_rejection_rate(), (unsigned long long)blocks_scanned,
+		       (unsigned long long)blocks_skipped, mean_ns(), latency_percentile_ns(0.5), latency_percentile_ns(0.99));
+	}
+};
+
+/**
+ * @brief Snapshot of all the statistics of one fence, returned by GeoFence::get_stats().
+ */
+class GeoFence_QueryStats
+{
+   public:
+	GeoFence_OperationStats is_inside;
+	GeoFence_OperationStats distance_to_boundary;
+
+	void print(const char *fence_name = "fence") const
+	{
+		printf("%s stats:\n", fence_name);
+		is_inside.print("is_inside");
+		distance_to_boundary.print("distance_to_boundary");
+	}
+};
+
+#ifdef GEOFENCE_ENABLE_STATS
+#include <atomic>
+#if defined(ESP32)
+#include "esp_timer.h"
+#elif defined(ARDUINO)
+#include "Arduino.h"
+#else
+#include <chrono>
+#endif
+
+static inline uint64_t geofence_stats_now_ns()
+{
+#if defined(ESP32)
+	return (uint64_t)esp_timer_get_time() * 1000;
+#elif defined(ARDUINO)
+	return (uint64_t)micros() * 1000;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief Live counters of one query type, copying a fence copies the current values.
+ */
+class GeoFence_OperationCounters
+{
+   public:
+	std::atomic<geofence_stats_counter_t> calls{0};
+	std::atomic<geofence_stats_counter_t> edges_tested{0};
+	std::atomic<geofence_stats_counter_t> early_rejections{0};
+	std::atomic<geofence_stats_counter_t> blocks_scanned{0};
+	std::atomic<geofence_stats_counter_t> blocks_skipped{0};
+	std::atomic<geofence_stats_counter_t> total_time{0};
+	std::atomic<geofence_stats_counter_t> latency_histogram[GEOFENCE_STATS_HISTOGRAM_BUCKETS] = {};
+
+	GeoFence_OperationCounters() {}
+	GeoFence_OperationCounters(const GeoFence_OperationCounters &other) { restore(other.snapshot()); }
+	GeoFence_OperationCounters &operator=(const GeoFence_OperationCounters &other)
+	{
+		restore(other.snapshot());
+		return *this;
+	}
+
+	void add(std::atomic<geofence_stats_counter_t> &counter, geofence_stats_counter_t value) const
+	{
+		counter.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	void record_latency(uint64_t ns)
+	{
+		int bucket = 0;
+		while (bucket < GEOFENCE_STATS_HISTOGRAM_BUCKETS - 1 && (ns >> (bucket + 1)) != 0) bucket++;
+		add(latency_histogram[bucket], 1);
+		add(total_time, (geofence_stats_counter_t)(ns / GEOFENCE_STATS_TIME_UNIT_NS));
+	}
+
+	GeoFence_OperationStats snapshot() const
+	{
+		GeoFence_OperationStats s;
+		s.calls = calls.load(std::memory_order_relaxed);
+		s.edges_tested = edges_tested.load(std::memory_order_relaxed);
+		s.early_rejections = early_rejections.load(std::memory_order_relaxed);
+		s.blocks_scanned = blocks_scanned.load(std::memory_order_relaxed);
+		s.blocks_skipped = blocks_skipped.load(std::memory_order_relaxed);
+		s.total_time = total_time.load(std::memory_order_relaxed);
+		for (int k = 0; k < GEOFENCE_STATS_HISTOGRAM_BUCKETS; k++) s.latency_histogram[k] = latency_histogram[k].load(std::memory_order_relaxed);
+		return s;
+	}
+
+	void restore(const GeoFence_OperationStats &s)
+	{
+		calls.store(s.calls, std::memory_order_relaxed);
+		edges_tested.store(s.edges_tested, std::memory_order_relaxed);
+		early_rejections.store(s.early_rejections, std::memory_order_relaxed);
+		blocks_scanned.store(s.blocks_scanned, std::memory_order_relaxed);
+		blocks_skipped.store(s.blocks_skipped, std::memory_order_relaxed);
+		total_time.store(s.total_time, std::memory_order_relaxed);
+		for (int k = 0; k < GEOFENCE_STATS_HISTOGRAM_BUCKETS; k++) latency_histogram[k].store(s.latency_histogram[k], std::memory_order_relaxed);
+	}
+};
+
+/**
+ * @brief Counts the call and records its latency when it goes out of scope.
+ */
+class GeoFence_StatsTimer
+{
+   private:
+	GeoFence_OperationCounters &counters;
+	uint64_t start;
+
+   public:
+	GeoFence_StatsTimer(GeoFence_OperationCounters &c) : counters(c), start(geofence_stats_now_ns()) { counters.add(counters.calls, 1); }
+	~GeoFence_StatsTimer() { counters.record_latency(geofence_stats_now_ns() - start); }
+};
+
+#define GEOFENCE_STATS(...) __VA_ARGS__
+#else
+#define GEOFENCE_STATS(...)
+#endif
@@ -0,0 +1,366 @@
+/**
+ * @file geofence_validate.h
+ * @brief Checks that a fence is a simple counterclockwise polygon and fixes what can be fixed, run it once after building or importing a
+ * fence.
+ *
+ * Self intersections are found with a sweep line over the edges (Shamos-Hoey), O(n log n), so 100k vertex imports are checked in
+ * milliseconds. Duplicate and collinear vertices are found in one pass over the vertices.
+ *
+ * Usage:
+ *   GeoFence fence;
+ *   ... add_point() for every vertex of the import ...
+ *   GeoFence_Validation result = GeoFence_Validator::normalize(fence);    // drops duplicates and collinear vertices, makes it ccw
+ *   if (!result.is_valid()) result.print();                                 // self intersections can't be fixed automatically
+ */
+#pragma once
+#include "geofence.h"
+#include <set>
+
+/**
+ * @brief What GeoFence_Validator found on a fence.
+ */
+class GeoFence_Validation
+{
+   public:
+	size_t vertices = 0;
+	size_t duplicate_vertices = 0;    // vertices equal to the next one (KML closes its rings with a copy of the first vertex)
+	size_t collinear_vertices = 0;    // vertices where the boundary doesn't turn, straight through or a spike back along the edge
+	bool self_intersecting = false;   // two edges that aren't neighbours cross or touch, or two neighbours overlap (a spike)
+	size_t intersecting_edge = 0;     // one such pair, edge e goes from vertex e to vertex e + 1
+	size_t other_intersecting_edge = 0;
+	double signed_area_degrees = 0;   // longitude x latitude, positive when counterclockwise
+
+	bool is_counter_clockwise() const { return signed_area_degrees > 0; }
+
+	/**
+	 * @brief A simple, counterclockwise polygon with at least 3 vertices and no repeated vertices. Collinear vertices are allowed, they
+	 * only cost time.
+	 */
+	bool is_valid() const { return vertices >= 3 && duplicate_vertices == 0 && !self_intersecting && is_counter_clockwise(); }
+
+	void print() const
+	{
+		printf("\tvertices: %u, duplicates: %u, collinear: %u, area: %.9f deg2 (%s)", (unsigned)vertices, (unsigned)duplicate_vertices,
+		       (unsigned)collinear_vertices, signed_area_degrees, is_counter_clockwise() ? "ccw" : "cw");
+		if (self_intersecting)
+			printf(", edges %u and %u intersect", (unsigned)intersecting_edge, (unsigned)other_intersecting_edge);
+		printf(" -> %s\n", is_valid() ? "valid" : "invalid");
+	}
+};
+
+class GeoFence_Validator
+{
+   private:
+	/**
+	 * @brief An edge with its end points ordered by longitude then latitude (left to right for the sweep).
+	 */
+	struct SweepEdge
+	{
+		double left_x, left_y, right_x, right_y;
+	};
+
+	struct SweepEvent
+	{
+		double x, y;
+		int removal;    // 0 insert, 1 remove: edges starting at x are inserted before the ones ending there are removed
+		size_t edge;
+
+		bool operator<(const SweepEvent &other) const
+		{
+			if (x != other.x) return x < other.x;
+			if (removal != other.removal) return removal < other.removal;
+			if (y != other.y) return y < other.y;
+			return edge < other.edge;
+		}
+	};
+
+	/**
+	 * @brief Longitude is x and latitude is y, same plane as GeoFence::is_inside().
+	 */
+	static int orientation(double ax, double ay, double bx, double by, double cx, double cy)
+	{
+		double cross = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+		return (cross > 0) - (cross < 0);
+	}
+
+	static int orientation(const GPS_Coordinate &a, const GPS_Coordinate &b, const GPS_Coordinate &c)
+	{
+		return orientation(a.longitude, a.latitude, b.longitude, b.latitude, c.longitude, c.latitude);
+	}
+
+	static bool same_vertex(const GPS_Coordinate &a, const GPS_Coordinate &b)
+	{
+		return a.latitude == b.latitude && a.longitude == b.longitude;
+	}
+
+	/**
+	 * @brief 1 if the point (x at or right of the edge start) is above the edge's line, -1 below, 0 on it. Vertical edges are seen as
+	 * tilted a hair to the right, so they have a slope like every other edge and the sweep order stays consistent.
+	 */
+	static int side_of(const SweepEdge &e, double x, double y)
+	{
+		if (e.left_x == e.right_x)
+		{
+			if (x > e.left_x) return -1;
+			return (y > e.left_y) - (y < e.left_y);
+		}
+		return orientation(e.left_x, e.left_y, e.right_x, e.right_y, x, y);
+	}
+
+	/**
+	 * @brief Order of the edges crossing the sweep line, bottom to top. Both edges span the sweep position, so the one that started
+	 * later is placed by where its start (or, when that lies on the other edge, its end) is.
+	 */
+	struct SweepOrder
+	{
+		const std::vector<SweepEdge> *edges;
+
+		bool operator()(size_t a, size_t b) const
+		{
+			if (a == b) return false;
+			const SweepEdge &ea = (*edges)[a], &eb = (*edges)[b];
+			bool b_starts_later = ea.left_x < eb.left_x || (ea.left_x == eb.left_x && ea.left_y <= eb.left_y);
+			if (b_starts_later)
+			{
+				int side = side_of(ea, eb.left_x, eb.left_y);
+				if (side == 0) side = side_of(ea, eb.right_x, eb.right_y);
+				if (side != 0) return side > 0;
+			}
+			else
+			{
+				int side = side_of(eb, ea.left_x, ea.left_y);
+				if (side == 0) side = side_of(eb, ea.right_x, ea.right_y);
+				if (side != 0) return side < 0;
+			}
+			return a < b;    // overlapping collinear edges, reported as an intersection when they meet
+		}
+	};
+
+	static bool on_segment(double ax, double ay, double bx, double by, double px, double py)
+	{
+		return std::min(ax, bx) <= px && px <= std::max(ax, bx) && std::min(ay, by) <= py && py <= std::max(ay, by);
+	}
+
+	static bool edges_intersect(const SweepEdge &p, const SweepEdge &q)
+	{
+		int d1 = orientation(q.left_x, q.left_y, q.right_x, q.right_y, p.left_x, p.left_y);
+		int d2 = orientation(q.left_x, q.left_y, q.right_x, q.right_y, p.right_x, p.right_y);
+		int d3 = orientation(p.left_x, p.left_y, p.right_x, p.right_y, q.left_x, q.left_y);
+		int d4 = orientation(p.left_x, p.left_y, p.right_x, p.right_y, q.right_x, q.right_y);
+		if (d1 * d2 < 0 && d3 * d4 < 0) return true;
+		if (d1 == 0 && on_segment(q.left_x, q.left_y, q.right_x, q.right_y, p.left_x, p.left_y)) return true;
+		if (d2 == 0 && on_segment(q.left_x, q.left_y, q.right_x, q.right_y, p.right_x, p.right_y)) return true;
+		if (d3 == 0 && on_segment(p.left_x, p.left_y, p.right_x, p.right_y, q.left_x, q.left_y)) return true;
+		if (d4 == 0 && on_segment(p.left_x, p.left_y, p.right_x, p.right_y, q.right_x, q.right_y)) return true;
+		return false;
+	}
+
+	/**
+	 * @brief Neighbouring edges that share more than their common vertex: a spike where the boundary goes back along the edge it came
+	 * from.
+	 */
+	static bool edges_overlap(const SweepEdge &p, const SweepEdge &q)
+	{
+		bool p_left_shared = (p.left_x == q.left_x && p.left_y == q.left_y) || (p.left_x == q.right_x && p.left_y == q.right_y);
+		double sx = p_left_shared ? p.left_x : p.right_x, sy = p_left_shared ? p.left_y : p.right_y;
+		double px = p_left_shared ? p.right_x : p.left_x, py = p_left_shared ? p.right_y : p.left_y;
+		bool q_left_shared = q.left_x == sx && q.left_y == sy;
+		double qx = q_left_shared ? q.right_x : q.left_x, qy = q_left_shared ? q.right_y : q.left_y;
+		return orientation(sx, sy, px, py, qx, qy) == 0 && (px - sx) * (qx - sx) + (py - sy) * (qy - sy) > 0;
+	}
+
+	/**
+	 * @brief Neighbouring edges always touch at their common vertex, that only counts when they overlap.
+	 */
+	static bool edges_cross(const std::vector<SweepEdge> &edges, size_t a, size_t b)
+	{
+		size_t n = edges.size();
+		if ((a + 1) % n == b || (b + 1) % n == a) return edges_overlap(edges[a], edges[b]);
+		return edges_intersect(edges[a], edges[b]);
+	}
+
+	static void make_edges(const std::vector<GPS_Coordinate> &boundary, std::vector<SweepEdge> &edges)
+	{
+		size_t n = boundary.size();
+		edges.resize(n);
+		for (size_t e = 0; e < n; e++)
+		{
+			const GPS_Coordinate &a = boundary[e], &b = boundary[(e + 1) % n];
+			bool a_first = a.longitude < b.longitude || (a.longitude == b.longitude && a.latitude <= b.latitude);
+			const GPS_Coordinate &l = a_first ? a : b, &r = a_first ? b : a;
+			edges[e] = {l.longitude, l.latitude, r.longitude, r.latitude};
+		}
+	}
+
+   public:
+	/**
+	 * @brief Sweep a vertical line over the edges keeping the ones it crosses sorted by latitude. The first intersection always shows up
+	 * between two edges that are next to each other in that order, so only those pairs are tested: O(n log n) instead of every pair.
+	 *
+	 * @param boundary polygon vertices, closed implicitly, consecutive copies of a vertex should be dropped first (see validate())
+	 * @param edge set to one of the intersecting edges when found
+	 * @param other_edge set to the other one
+	 * @return true when two edges that aren't neighbours cross or touch, or two neighbours overlap
+	 */
+	static bool find_self_intersection(const std::vector<GPS_Coordinate> &boundary, size_t &edge, size_t &other_edge)
+	{
+		size_t n = boundary.size();
+		if (n < 4) return false;    // every pair of edges of a triangle are neighbours
+
+		// a vertex visited twice is a touch where several edges meet in one point, skipping neighbouring edges would hide it from the
+		// sweep, so look for those first
+		std::vector<size_t> order(n);
+		for (size_t k = 0; k < n; k++) order[k] = k;
+		auto vertex_less = [&boundary](size_t a, size_t b)
+		{
+			if (boundary[a].longitude != boundary[b].longitude) return boundary[a].longitude < boundary[b].longitude;
+			if (boundary[a].latitude != boundary[b].latitude) return boundary[a].latitude < boundary[b].latitude;
+			return a < b;
+		};
+		std::sort(order.begin(), order.end(), vertex_less);
+		for (size_t k = 1; k < n; k++)
+		{
+			if (!same_vertex(boundary[order[k - 1]], boundary[order[k]])) continue;
+			edge = order[k - 1];    // the edges starting at both visits, they aren't neighbours unless the copies are consecutive
+			other_edge = order[k];
+			if ((edge + 1) % n != other_edge && (other_edge + 1) % n != edge) return true;
+		}
+
+		std::vector<SweepEdge> edges;
+		make_edges(boundary, edges);
+		std::vector<SweepEvent> events;
+		events.reserve(2 * n);
+		for (size_t e = 0; e < n; e++)
+		{
+			events.push_back({edges[e].left_x, edges[e].left_y, 0, e});
+			events.push_back({edges[e].right_x, edges[e].right_y, 1, e});
+		}
+		std::sort(events.begin(), events.end());
+
+		typedef std::set<size_t, SweepOrder> SweepStatus;
+		SweepStatus status(SweepOrder{&edges});
+		std::vector<SweepStatus::iterator> position(n);
+		auto report = [&](size_t a, size_t b) -> bool
+		{
+			if (!edges_cross(edges, a, b)) return false;
+			edge = std::min(a, b);
+			other_edge = std::max(a, b);
+			return true;
+		};
+
+		for (const SweepEvent &event : events)
+		{
+			if (!event.removal)
+			{
+				SweepStatus::iterator it = status.insert(event.edge).first;
+				position[event.edge] = it;
+				SweepStatus::iterator above = std::next(it);
+				if (above != status.end() && report(event.edge, *above)) return true;
+				if (it != status.begin() && report(event.edge, *std::prev(it))) return true;
+			}
+			else
+			{
+				SweepStatus::iterator it = position[event.edge];
+				SweepStatus::iterator above = std::next(it);
+				if (it != status.begin() && above != status.end() && report(*std::prev(it), *above)) return true;
+				status.erase(it);
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Check a fence without changing it.
+	 */
+	static GeoFence_Validation validate(const GeoFence &fence)
+	{
+		const std::vector<GPS_Coordinate> &boundary = fence.boundary_coordinates;
+		GeoFence_Validation result;
+		size_t n = boundary.size();
+		result.vertices = n;
+		double twice_area = 0;
+		for (size_t k = 0; k < n; k++)
+		{
+			const GPS_Coordinate &before = boundary[(k + n - 1) % n], &vertex = boundary[k], &after = boundary[(k + 1) % n];
+			if (same_vertex(vertex, after))
+				result.duplicate_vertices++;
+			else if (!same_vertex(before, vertex) && orientation(before, vertex, after) == 0)
+				result.collinear_vertices++;
+			twice_area += (double)vertex.longitude * after.latitude - (double)after.longitude * vertex.latitude;
+		}
+		result.signed_area_degrees = twice_area / 2;
+
+		// the sweep sees repeated vertices as one, otherwise the edges around a zero length edge would touch without being neighbours
+		std::vector<GPS_Coordinate> distinct;
+		std::vector<size_t> original_edge;
+		distinct.reserve(n);
+		original_edge.reserve(n);
+		for (size_t k = 0; k < n; k++)
+		{
+			if (same_vertex(boundary[k], boundary[(k + 1) % n])) continue;
+			distinct.push_back(boundary[k]);
+			original_edge.push_back(k);
+		}
+		size_t edge, other_edge;
+		if (find_self_intersection(distinct, edge, other_edge))
+		{
+			result.self_intersecting = true;
+			result.intersecting_edge = original_edge[edge];
+			result.other_intersecting_edge = original_edge[other_edge];
+		}
+		return result;
+	}
+
+	/**
+	 * @brief Fix what can be fixed without changing the fenced area: drop repeated and collinear vertices and reverse clockwise fences.
+	 * The index is rebuilt afterwards. Self intersections are only reported, splitting the polygon is left to whoever drew it.
+	 *
+	 * @return the validation of the fixed fence
+	 */
+	static GeoFence_Validation normalize(GeoFence &fence)
+	{
+		std::vector<GPS_Coordinate> kept;
+		kept.reserve(fence.boundary_coordinates.size());
+		for (const GPS_Coordinate &vertex : fence.boundary_coordinates)
+		{
+			while (kept.size() >= 2 && !same_vertex(kept.back(), vertex) && orientation(kept[kept.size() - 2], kept.back(), vertex) == 0)
+				kept.pop_back();
+			if (kept.empty() || !same_vertex(kept.back(), vertex)) kept.push_back(vertex);
+		}
+
+		// the pass above doesn't see the vertices around the seam between the last and the first vertex
+		size_t first = 0;
+		bool changed = true;
+		while (changed && kept.size() - first >= 3)
+		{
+			changed = false;
+			if (same_vertex(kept.back(), kept[first]) || orientation(kept[kept.size() - 2], kept.back(), kept[first]) == 0)
+			{
+				kept.pop_back();
+				changed = true;
+			}
+			else if (orientation(kept.back(), kept[first], kept[first + 1]) == 0)
+			{
+				first++;
+				changed = true;
+			}
+		}
+		fence.boundary_coordinates.assign(kept.begin() + first, kept.end());
+
+		GeoFence_Validation result = validate(fence);
+		if (result.signed_area_degrees < 0)
+		{
+			std::reverse(fence.boundary_coordinates.begin(), fence.boundary_coordinates.end());
+			result.signed_area_degrees = -result.signed_area_degrees;
+			if (result.self_intersecting)
+			{
+				size_t n = fence.boundary_coordinates.size();    // edge e now goes from vertex n - 2 - e to n - 1 - e
+				size_t edge = (2 * n - 2 - result.intersecting_edge) % n, other_edge = (2 * n - 2 - result.other_intersecting_edge) % n;
+				result.intersecting_edge = std::min(edge, other_edge);
+				result.other_intersecting_edge = std::max(edge, other_edge);
+			}
+		}
+		fence.rebuild_index();
+		return result;
+	}
+};
@@ -0,0 +1,428 @@
+/**
+ * @file geofence_wgs84.h
+ * @brief Distances on the WGS84 ellipsoid. GeoFence measures on a sphere of 6371 km, which is off by up to 0.5% depending on the
+ * latitude and the direction (about 1.5 m on a 450 m span at 23 S), too much for fences a few meters wide.
+ *
+ * GeoFence_Wgs84::vincenty_distance() is the reference point to point geodesic (Vincenty's inverse formula, sub-millimeter).
+ * GeoFence_Wgs84Fence is the cheap mode for distance_to_boundary(). When it is built, the edges are cut in blocks of at most
+ * GEOFENCE_EDGE_BLOCK_SIZE edges spanning at most GEOFENCE_WGS84_BLOCK_SPAN_M, and every vertex is placed once in the plane tangent to
+ * the ellipsoid at the centre of its block (east/north meters, through the radii of curvature of the ellipsoid there), with the edge
+ * constants and block boxes. A query then costs one projection of the point (a sin/cos pair per axis and a sqrt), two dot products
+ * per block and a few multiply-adds per edge of the blocks it can't skip, less than the spherical calculate_distance_to_segment(),
+ * which redoes the trigonometry of both vertices for every edge. Within GEOFENCE_WGS84_LOCAL_RANGE_M of the boundary the planes are
+ * good to about 1 cm per km of distance; farther away the nearest boundary point is found on the ellipsoid chords of the edges and its
+ * distance measured with Vincenty.
+ *
+ * Usage:
+ *   GeoFence_Wgs84Fence wgs84(fence);                     // rebuild it after editing the fence
+ *   double meters = wgs84.distance_to_boundary(position);
+ *   double exact = GeoFence_Wgs84::vincenty_distance(a, b);
+ */
+#pragma once
+#include "geofence.h"
+
+#define GEOFENCE_WGS84_A 6378137.0                  // semi-major axis, meters
+#define GEOFENCE_WGS84_F (1 / 298.257223563)        // flattening
+#define GEOFENCE_WGS84_B (GEOFENCE_WGS84_A * (1 - GEOFENCE_WGS84_F))
+#define GEOFENCE_WGS84_E2 (GEOFENCE_WGS84_F * (2 - GEOFENCE_WGS84_F))    // first eccentricity squared
+
+#ifndef GEOFENCE_WGS84_LOCAL_RANGE_M
+#define GEOFENCE_WGS84_LOCAL_RANGE_M 20000.0    // points farther than this from every edge are measured with Vincenty
+#endif
+
+#ifndef GEOFENCE_WGS84_BLOCK_SPAN_M
+#define GEOFENCE_WGS84_BLOCK_SPAN_M 2000.0    // a block of edges is closed before its vertices get farther than this from its first one
+#endif
+
+class GeoFence_Wgs84
+{
+   public:
+	/**
+	 * @brief Radius of curvature along the meridian at a latitude in radians.
+	 */
+	static double meridian_radius(double lat)
+	{
+		double s = sin(lat);
+		double w = 1 - GEOFENCE_WGS84_E2 * s * s;
+		return GEOFENCE_WGS84_A * (1 - GEOFENCE_WGS84_E2) / (w * sqrt(w));
+	}
+
+	/**
+	 * @brief Radius of curvature in the prime vertical (east-west) at a latitude in radians.
+	 */
+	static double prime_vertical_radius(double lat)
+	{
+		double s = sin(lat);
+		return GEOFENCE_WGS84_A / sqrt(1 - GEOFENCE_WGS84_E2 * s * s);
+	}
+
+	/**
+	 * @brief Earth centered, earth fixed position in meters of a point on the ellipsoid surface, latitude/longitude in degrees.
+	 */
+	static void to_ecef(double latitude, double longitude, double out[3])
+	{
+		double lat = latitude * IMPL_M_PI / 180.0, lon = longitude * IMPL_M_PI / 180.0;
+		double n = prime_vertical_radius(lat);
+		out[0] = n * cos(lat) * cos(lon);
+		out[1] = n * cos(lat) * sin(lon);
+		out[2] = n * (1 - GEOFENCE_WGS84_E2) * sin(lat);
+	}
+
+	/**
+	 * @brief Latitude and longitude in degrees of an ECEF position, projected along the ellipsoid normal (the height is dropped).
+	 */
+	static void from_ecef(const double e[3], double &latitude, double &longitude)
+	{
+		double p = sqrt(e[0] * e[0] + e[1] * e[1]);
+		double lat = atan2(e[2], p * (1 - GEOFENCE_WGS84_E2));
+		for (int k = 0; k < 4; k++)
+		{
+			double n = prime_vertical_radius(lat);
+			double height = fabs(lat) < IMPL_M_PI / 4 ? p / cos(lat) - n : e[2] / sin(lat) - n * (1 - GEOFENCE_WGS84_E2);
+			lat = atan2(e[2], p * (1 - GEOFENCE_WGS84_E2 * n / (n + height)));
+		}
+		latitude = lat * 180.0 / IMPL_M_PI;
+		longitude = atan2(e[1], e[0]) * 180.0 / IMPL_M_PI;
+	}
+
+	/**
+	 * @brief Geodesic distance in meters between two points in decimal degrees (Vincenty's inverse formula). Nearly antipodal points,
+	 * where the iteration does not converge, get the distance on the sphere of the same volume.
+	 */
+	static double vincenty_distance(double latitude1, double longitude1, double latitude2, double longitude2)
+	{
+		const double f = GEOFENCE_WGS84_F, a = GEOFENCE_WGS84_A, b = GEOFENCE_WGS84_B;
+		double L = (longitude2 - longitude1) * IMPL_M_PI / 180.0;
+		double U1 = atan((1 - f) * tan(latitude1 * IMPL_M_PI / 180.0));
+		double U2 = atan((1 - f) * tan(latitude2 * IMPL_M_PI / 180.0));
+		double sinU1 = sin(U1), cosU1 = cos(U1), sinU2 = sin(U2), cosU2 = cos(U2);
+
+		double lambda = L, sin_sigma = 0, cos_sigma = 1, sigma = 0, cos_sq_alpha = 1, cos_2sigma_m = 0;
+		int iteration = 0;
+		for (; iteration < 200; iteration++)
+		{
+			double sin_lambda = sin(lambda), cos_lambda = cos(lambda);
+			double t1 = cosU2 * sin_lambda, t2 = cosU1 * sinU2 - sinU1 * cosU2 * cos_lambda;
+			sin_sigma = sqrt(t1 * t1 + t2 * t2);
+			if (sin_sigma == 0) return 0;    // same point
+			cos_sigma = sinU1 * sinU2 + cosU1 * cosU2 * cos_lambda;
+			sigma = atan2(sin_sigma, cos_sigma);
+			double sin_alpha = cosU1 * cosU2 * sin_lambda / sin_sigma;
+			cos_sq_alpha = 1 - sin_alpha * sin_alpha;
+			cos_2sigma_m = cos_sq_alpha != 0 ? cos_sigma - 2 * sinU1 * sinU2 / cos_sq_alpha : 0;    // 0 on the equator
+			double C = f / 16 * cos_sq_alpha * (4 + f * (4 - 3 * cos_sq_alpha));
+			double previous = lambda;
+			lambda = L + (1 - C) * f * sin_alpha *
+			                 (sigma + C * sin_sigma * (cos_2sigma_m + C * cos_sigma * (-1 + 2 * cos_2sigma_m * cos_2sigma_m)));
+			if (fabs(lambda - previous) < 1e-12) break;
+		}
+		if (iteration == 200)
+		{
+			double lat1 = latitude1 * IMPL_M_PI / 180.0, lat2 = latitude2 * IMPL_M_PI / 180.0;
+			double h = sin((lat2 - lat1) / 2) * sin((lat2 - lat1) / 2) + cos(lat1) * cos(lat2) * sin(L / 2) * sin(L / 2);
+			return 2 * 6371000.8 * asin(std::min(1.0, sqrt(h)));
+		}
+
+		double u_sq = cos_sq_alpha * (a * a - b * b) / (b * b);
+		double A = 1 + u_sq / 16384 * (4096 + u_sq * (-768 + u_sq * (320 - 175 * u_sq)));
+		double B = u_sq / 1024 * (256 + u_sq * (-128 + u_sq * (74 - 47 * u_sq)));
+		double delta_sigma =
+		    B * sin_sigma *
+		    (cos_2sigma_m + B / 4 *
+		                        (cos_sigma * (-1 + 2 * cos_2sigma_m * cos_2sigma_m) -
+		                         B / 6 * cos_2sigma_m * (-3 + 4 * sin_sigma * sin_sigma) * (-3 + 4 * cos_2sigma_m * cos_2sigma_m)));
+		return b * A * (sigma - delta_sigma);
+	}
+
+	static double vincenty_distance(const GPS_Coordinate &a, const GPS_Coordinate &b)
+	{
+		return vincenty_distance(a.latitude, a.longitude, b.latitude, b.longitude);
+	}
+
+	/**
+	 * @brief Distance in meters from P to the edge A -> B on the ellipsoid, the ellipsoidal counterpart of
+	 * GeoFence::calculate_distance_to_segment(). Measured in the plane tangent to the ellipsoid at P, good for edges and distances up
+	 * to a few tens of km. GeoFence_Wgs84Fence gives the same answer for a whole fence without the per edge trigonometry.
+	 */
+	static double distance_to_segment(const GPS_Coordinate &A, const GPS_Coordinate &B, const GPS_Coordinate &P)
+	{
+		double a[3], b[3], p[3];
+		to_ecef(A.latitude, A.longitude, a);
+		to_ecef(B.latitude, B.longitude, b);
+		to_ecef(P.latitude, P.longitude, p);
+		double lat = P.latitude * IMPL_M_PI / 180.0, lon = P.longitude * IMPL_M_PI / 180.0;
+		double up[3] = {cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat)};    // ellipsoid normal at P
+
+		// horizontal parts of A - P and of the edge, the nearest point of the edge in that plane
+		double ap[3] = {a[0] - p[0], a[1] - p[1], a[2] - p[2]};
+		double e[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+		double ap_up = ap[0] * up[0] + ap[1] * up[1] + ap[2] * up[2];
+		double e_up = e[0] * up[0] + e[1] * up[1] + e[2] * up[2];
+		double ap_e = ap[0] * e[0] + ap[1] * e[1] + ap[2] * e[2] - ap_up * e_up;
+		double e_e = e[0] * e[0] + e[1] * e[1] + e[2] * e[2] - e_up * e_up;
+		double ap_ap = ap[0] * ap[0] + ap[1] * ap[1] + ap[2] * ap[2] - ap_up * ap_up;
+		double t = e_e > 0 ? std::min(1.0, std::max(0.0, -ap_e / e_e)) : 0;
+		return sqrt(std::max(0.0, ap_ap + 2 * t * ap_e + t * t * e_e));
+	}
+};
+
+/**
+ * @brief Consecutive edges of a GeoFence_Wgs84Fence, the plane tangent to the ellipsoid at their centre and their box in it.
+ */
+class GeoFence_Wgs84Block
+{
+   public:
+	size_t first_edge;
+	size_t edge_count;
+	double origin[3];    // ECEF of the tangent point
+	double east[3];
+	double north[3];
+	double radius_m;     // largest ECEF distance of a vertex of the block from origin
+	double min_x, max_x, min_y, max_y;
+
+	/**
+	 * @brief Meters east and north of origin of an ECEF position, false (and nothing set) when it is more than
+	 * GEOFENCE_WGS84_LOCAL_RANGE_M away from every vertex of the block, where the plane is no longer accurate.
+	 */
+	bool project(const double e[3], double &px, double &py) const
+	{
+		double d[3] = {e[0] - origin[0], e[1] - origin[1], e[2] - origin[2]};
+		double reach = radius_m + GEOFENCE_WGS84_LOCAL_RANGE_M;
+		if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] > reach * reach) return false;
+		px = d[0] * east[0] + d[1] * east[1];
+		py = d[0] * north[0] + d[1] * north[1] + d[2] * north[2];
+		return true;
+	}
+
+	double box_distance_squared(double px, double py) const
+	{
+		double ox = std::max(0.0, std::max(min_x - px, px - max_x));
+		double oy = std::max(0.0, std::max(min_y - py, py - max_y));
+		return ox * ox + oy * oy;
+	}
+};
+
+/**
+ * @brief Ellipsoidal distance_to_boundary() for one fence, built from a GeoFence and independent of it afterwards (rebuild it with
+ * assign() after editing the fence).
+ */
+class GeoFence_Wgs84Fence
+{
+   private:
+	std::vector<GPS_Coordinate> vertices;
+	std::vector<double> x, y, dx, dy, inverse_length_squared;    // edge k in the plane of its block: start vertex and end - start
+	std::vector<double> ex, ey, ez;                              // vertex ECEF
+	std::vector<GeoFence_Wgs84Block> blocks;
+	double centre[3] = {0, 0, 0};    // ECEF centre of the fence and distance of its farthest vertex, to send far points to Vincenty
+	double reach_m = 0;
+
+	double block_distance_squared(const GeoFence_Wgs84Block &b, double px, double py) const
+	{
+		double best = std::numeric_limits<double>::max();
+		for (size_t e = b.first_edge; e < b.first_edge + b.edge_count; e++)
+		{
+			double ax = x[e] - px, ay = y[e] - py;
+			double t = -(ax * dx[e] + ay * dy[e]) * inverse_length_squared[e];
+			t = t < 0 ? 0 : (t > 1 ? 1 : t);
+			double qx = ax + t * dx[e], qy = ay + t * dy[e];
+			best = std::min(best, qx * qx + qy * qy);
+		}
+		return best;
+	}
+
+	/**
+	 * @brief Points far from the fence: the nearest point of the ECEF chords of the edges, brought up to the surface and measured with
+	 * Vincenty.
+	 */
+	double far_distance(const GPS_Coordinate &p, const double pe[3]) const
+	{
+		size_t n = vertices.size(), best_edge = 0;
+		double best = std::numeric_limits<double>::max(), best_t = 0;
+		for (size_t e = 0; e < n; e++)
+		{
+			size_t next = (e + 1) % n;
+			double ux = ex[next] - ex[e], uy = ey[next] - ey[e], uz = ez[next] - ez[e];
+			double ax = pe[0] - ex[e], ay = pe[1] - ey[e], az = pe[2] - ez[e];
+			double uu = ux * ux + uy * uy + uz * uz;
+			double t = uu > 0 ? std::min(1.0, std::max(0.0, (ax * ux + ay * uy + az * uz) / uu)) : 0;
+			double qx = ax - t * ux, qy = ay - t * uy, qz = az - t * uz;
+			double d = qx * qx + qy * qy + qz * qz;
+			if (d < best)
+			{
+				best = d;
+				best_edge = e;
+				best_t = t;
+			}
+		}
+		size_t next = (best_edge + 1) % n;
+		double q[3] = {ex[best_edge] + best_t * (ex[next] - ex[best_edge]), ey[best_edge] + best_t * (ey[next] - ey[best_edge]),
+		               ez[best_edge] + best_t * (ez[next] - ez[best_edge])};
+		double latitude, longitude;
+		GeoFence_Wgs84::from_ecef(q, latitude, longitude);
+		return GeoFence_Wgs84::vincenty_distance(p.latitude, p.longitude, latitude, longitude);
+	}
+
+	double vertex_distance(size_t a, size_t b) const
+	{
+		double d[3] = {ex[a] - ex[b], ey[a] - ey[b], ez[a] - ez[b]};
+		return sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	}
+
+	/**
+	 * @brief Tangent plane at the centre of vertices [first, first + edge_count] and the edges of the block in it.
+	 */
+	void build_block(GeoFence_Wgs84Block &b)
+	{
+		size_t n = vertices.size();
+		double mean[3] = {0, 0, 0};
+		for (size_t k = 0; k <= b.edge_count; k++)
+		{
+			size_t v = (b.first_edge + k) % n;
+			mean[0] += ex[v];
+			mean[1] += ey[v];
+			mean[2] += ez[v];
+		}
+		for (double &m : mean) m /= b.edge_count + 1;
+		double latitude, longitude;
+		GeoFence_Wgs84::from_ecef(mean, latitude, longitude);
+		GeoFence_Wgs84::to_ecef(latitude, longitude, b.origin);
+		double lat = latitude * IMPL_M_PI / 180.0, lon = longitude * IMPL_M_PI / 180.0;
+		b.east[0] = -sin(lon);
+		b.east[1] = cos(lon);
+		b.east[2] = 0;
+		b.north[0] = -sin(lat) * cos(lon);
+		b.north[1] = -sin(lat) * sin(lon);
+		b.north[2] = cos(lat);
+
+		b.radius_m = 0;
+		b.min_x = b.min_y = std::numeric_limits<double>::max();
+		b.max_x = b.max_y = -std::numeric_limits<double>::max();
+		for (size_t k = 0; k <= b.edge_count; k++)
+		{
+			size_t v = (b.first_edge + k) % n;
+			double d[3] = {ex[v] - b.origin[0], ey[v] - b.origin[1], ez[v] - b.origin[2]};
+			double vx = d[0] * b.east[0] + d[1] * b.east[1];
+			double vy = d[0] * b.north[0] + d[1] * b.north[1] + d[2] * b.north[2];
+			b.radius_m = std::max(b.radius_m, sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+			b.min_x = std::min(b.min_x, vx);
+			b.max_x = std::max(b.max_x, vx);
+			b.min_y = std::min(b.min_y, vy);
+			b.max_y = std::max(b.max_y, vy);
+			if (k < b.edge_count)
+			{
+				x[v] = vx;
+				y[v] = vy;
+			}
+			if (k > 0)
+			{
+				size_t e = (v + n - 1) % n;
+				dx[e] = vx - x[e];
+				dy[e] = vy - y[e];
+				double length_squared = dx[e] * dx[e] + dy[e] * dy[e];
+				inverse_length_squared[e] = length_squared > 0 ? 1 / length_squared : 0;
+			}
+		}
+	}
+
+   public:
+	GeoFence_Wgs84Fence() {}
+	GeoFence_Wgs84Fence(const GeoFence &fence) { assign(fence); }
+
+	size_t size() const { return vertices.size(); }
+
+	const std::vector<GeoFence_Wgs84Block> &get_blocks() const { return blocks; }
+
+	/**
+	 * @brief ECEF centre of the vertices and the distance of the farthest vertex from it, points farther than reach +
+	 * GEOFENCE_WGS84_LOCAL_RANGE_M from the centre take the far path.
+	 */
+	const double *get_centre() const { return centre; }
+	double get_reach_m() const { return reach_m; }
+
+	void assign(const GeoFence &fence)
+	{
+		vertices = fence.boundary_coordinates;
+		size_t n = vertices.size();
+		x.assign(n, 0);
+		y.assign(n, 0);
+		dx.assign(n, 0);
+		dy.assign(n, 0);
+		inverse_length_squared.assign(n, 0);
+		ex.assign(n, 0);
+		ey.assign(n, 0);
+		ez.assign(n, 0);
+		blocks.clear();
+		centre[0] = centre[1] = centre[2] = 0;
+		reach_m = 0;
+		if (n == 0) return;
+
+		for (size_t k = 0; k < n; k++)
+		{
+			double e[3];
+			GeoFence_Wgs84::to_ecef(vertices[k].latitude, vertices[k].longitude, e);
+			ex[k] = e[0];
+			ey[k] = e[1];
+			ez[k] = e[2];
+			centre[0] += e[0] / n;
+			centre[1] += e[1] / n;
+			centre[2] += e[2] / n;
+		}
+		for (size_t k = 0; k < n; k++)
+		{
+			double d[3] = {ex[k] - centre[0], ey[k] - centre[1], ez[k] - centre[2]};
+			reach_m = std::max(reach_m, sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+		}
+
+		// up to GEOFENCE_EDGE_BLOCK_SIZE edges per block, closed early once the next vertex is GEOFENCE_WGS84_BLOCK_SPAN_M from the first
+		for (size_t first = 0; first < n;)
+		{
+			GeoFence_Wgs84Block b;
+			b.first_edge = first;
+			b.edge_count = 1;
+			while (b.edge_count < GEOFENCE_EDGE_BLOCK_SIZE && first + b.edge_count < n &&
+			       vertex_distance(first, (first + b.edge_count + 1) % n) <= GEOFENCE_WGS84_BLOCK_SPAN_M)
+				b.edge_count++;
+			build_block(b);
+			blocks.push_back(b);
+			first += b.edge_count;
+		}
+	}
+
+	/**
+	 * @brief Distance in meters from p to the nearest edge on the WGS84 ellipsoid, max() for an empty fence.
+	 */
+	double distance_to_boundary(const GPS_Coordinate &p) const
+	{
+		if (vertices.empty()) return std::numeric_limits<double>::max();
+		double e[3];
+		GeoFence_Wgs84::to_ecef(p.latitude, p.longitude, e);
+		double c[3] = {e[0] - centre[0], e[1] - centre[1], e[2] - centre[2]};
+		double reach = reach_m + GEOFENCE_WGS84_LOCAL_RANGE_M;
+		if (c[0] * c[0] + c[1] * c[1] + c[2] * c[2] > reach * reach) return far_distance(p, e);
+
+		// the block with the nearest box first, then only the blocks whose box is closer than the best edge so far
+		size_t nearest = blocks.size();
+		double nearest_box = std::numeric_limits<double>::max(), px = 0, py = 0;
+		for (size_t b = 0; b < blocks.size(); b++)
+		{
+			if (!blocks[b].project(e, px, py)) continue;
+			double box = blocks[b].box_distance_squared(px, py);
+			if (box < nearest_box)
+			{
+				nearest_box = box;
+				nearest = b;
+			}
+		}
+		if (nearest == blocks.size()) return far_distance(p, e);
+		blocks[nearest].project(e, px, py);
+		double best = block_distance_squared(blocks[nearest], px, py);
+		for (size_t b = 0; b < blocks.size(); b++)
+		{
+			if (b == nearest || !blocks[b].project(e, px, py) || blocks[b].box_distance_squared(px, py) >= best) continue;
+			best = std::min(best, block_distance_squared(blocks[b], px, py));
+		}
+		// blocks that were too far to project are more than GEOFENCE_WGS84_LOCAL_RANGE_M away
+		if (best > GEOFENCE_WGS84_LOCAL_RANGE_M * GEOFENCE_WGS84_LOCAL_RANGE_M) return far_distance(p, e);
+		return sqrt(best);
+	}
+};
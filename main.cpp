@@ -1,9 +1,24 @@
 #include "geofence.h"
 #include "class_testing.h"
+#include "class_benchmark.h"
 
 #if defined(_WIN32) || defined(__linux__)
-int main()
+#include <cstring>
+#include <cstdlib>
+
+int main(int argc, char **argv)
 {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+	{
+		benchmark_geofence();
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--diff") == 0)
+	{
+		int fences = (argc > 2) ? atoi(argv[2]) : 10000;
+		uint32_t seed = (argc > 3) ? strtoul(argv[3], nullptr, 10) : 1;
+		return differential_run(fences, seed) == 0 ? 0 : 1;
+	}
 	test_geofence();
 	system("pause");
 	return 1;
@@ -12,4 +27,4 @@ int main()
 
 #if defined(ESP32) || defined(ARDUINO)
 #warning "dont forget to add the test_geofence in your code"
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,8 @@
+// Second test executable: the same tests and benchmarks as main.cpp with the query statistics compiled in, so both configurations of
+// geofence.h are built and tested.
+//   g++ -Wall -Wextra -O2 -o geofence_tests main.cpp && ./geofence_tests
+//   g++ -Wall -Wextra -O2 -o geofence_tests_stats main_stats.cpp && ./geofence_tests_stats
+#if defined(_WIN32) || defined(__linux__)
+#define GEOFENCE_ENABLE_STATS
+#include "main.cpp"
+#endif
@@ -0,0 +1,408 @@
+/**
+ * @file geofence_module.cpp
+ * @brief Native Python module over geofence.h for batch analytics on a PC. The coordinate arrays are read through the buffer protocol,
+ * so NumPy arrays (any stride, float64 or float32), array.array and memoryview objects are used in place without a copy, and the batch
+ * loops run with the GIL released so several threads can evaluate at once. NumPy is not needed to build or import the module.
+ *
+ * Build:
+ *   cd python_tools && python3 setup.py build_ext --inplace
+ *
+ * Usage:
+ *   import geofence, numpy as np
+ *   fence = geofence.Fence([(-23.5505, -46.6333), (-23.5510, -46.6300), (-23.5540, -46.6320)])    # (latitude, longitude) pairs
+ *   inside = np.asarray(fence.is_inside(lat, lon))                  # bool per point
+ *   meters = np.empty(len(lat)); fence.distance_to_boundary(lat, lon, out=meters)
+ *   which = np.asarray(geofence.first_containing([a, b], lat, lon))    # int32, -1 when no fence contains the point
+ *
+ * Test: python3 test_geofence_module.py (after the build)
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "../geofence.h"
+#include <cstring>
+
+/**
+ * @brief A 1-D buffer of coordinates or results, with the element read or written through the format it was exported with.
+ */
+class GeoFence_PyArray
+{
+   public:
+	Py_buffer view;
+	bool held = false;
+	char format = 0;
+
+	~GeoFence_PyArray()
+	{
+		if (held) PyBuffer_Release(&view);
+	}
+
+	/**
+	 * @param formats struct format characters accepted, e.g. "df"
+	 * @return false with a Python exception set when obj is not a suitable 1-D buffer
+	 */
+	bool acquire(PyObject *obj, const char *name, const char *formats, bool writable)
+	{
+		if (PyObject_GetBuffer(obj, &view, PyBUF_STRIDES | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0)) != 0) return false;
+		held = true;
+		const char *f = view.format ? view.format : "B";
+		if (*f == '@' || *f == '=' || (*f == '<' && PY_LITTLE_ENDIAN) || (*f == '>' && !PY_LITTLE_ENDIAN)) f++;
+		if (view.ndim != 1 || f[0] == 0 || f[1] != 0 || !strchr(formats, f[0]))
+		{
+			PyErr_Format(PyExc_TypeError, "%s must be a 1-D array of one of the types '%s' (got ndim %d, format '%s')", name, formats,
+			             view.ndim, view.format ? view.format : "B");
+			return false;
+		}
+		format = f[0];
+		return true;
+	}
+
+	Py_ssize_t size() const { return view.shape[0]; }
+
+	char *at(Py_ssize_t i) const { return (char *)view.buf + i * view.strides[0]; }
+
+	float get_float(Py_ssize_t i) const
+	{
+		if (format == 'd')
+		{
+			double v;
+			memcpy(&v, at(i), sizeof(v));
+			return (float)v;
+		}
+		float v;
+		memcpy(&v, at(i), sizeof(v));
+		return v;
+	}
+
+	void set_double(Py_ssize_t i, double v) const
+	{
+		if (format == 'd') memcpy(at(i), &v, sizeof(v));
+		else
+		{
+			float f = (float)v;
+			memcpy(at(i), &f, sizeof(f));
+		}
+	}
+
+	/**
+	 * @brief Store an index in a signed integer buffer, 'i', 'l' or 'q' of 4 or 8 bytes ('l' is 8 bytes on Linux, 4 on Windows).
+	 */
+	void set_int(Py_ssize_t i, long long v) const
+	{
+		if (view.itemsize == 4)
+		{
+			int32_t x = (int32_t)v;
+			memcpy(at(i), &x, sizeof(x));
+		}
+		else
+		{
+			int64_t x = (int64_t)v;
+			memcpy(at(i), &x, sizeof(x));
+		}
+	}
+};
+
+/**
+ * @brief Result memoryview over a new bytearray, used when the caller gives no out array. np.asarray() wraps it without a copy.
+ */
+static PyObject *new_result(Py_ssize_t count, size_t item_size, const char *format)
+{
+	PyObject *bytes = PyByteArray_FromStringAndSize(nullptr, count * (Py_ssize_t)item_size);
+	if (!bytes) return nullptr;
+	PyObject *raw = PyMemoryView_FromObject(bytes);
+	Py_DECREF(bytes);
+	if (!raw) return nullptr;
+	PyObject *typed = PyObject_CallMethod(raw, "cast", "s", format);
+	Py_DECREF(raw);
+	return typed;
+}
+
+/**
+ * @brief lat, lon and the optional out argument of a batch call, checked for matching lengths. result holds the object to return.
+ */
+class GeoFence_PyBatch
+{
+   public:
+	GeoFence_PyArray lat, lon, out;
+	PyObject *result = nullptr;
+
+	~GeoFence_PyBatch() { Py_XDECREF(result); }
+
+	bool acquire(PyObject *lat_obj, PyObject *lon_obj, PyObject *out_obj, const char *out_formats, size_t item_size, const char *format)
+	{
+		if (!lat.acquire(lat_obj, "lat", "df", false) || !lon.acquire(lon_obj, "lon", "df", false)) return false;
+		if (lat.size() != lon.size())
+		{
+			PyErr_SetString(PyExc_ValueError, "lat and lon must have the same length");
+			return false;
+		}
+		if (out_obj == nullptr || out_obj == Py_None)
+		{
+			result = new_result(lat.size(), item_size, format);
+			if (!result) return false;
+			out_obj = result;
+		}
+		else
+		{
+			result = out_obj;
+			Py_INCREF(result);
+		}
+		if (!out.acquire(out_obj, "out", out_formats, true)) return false;
+		if (out.size() != lat.size())
+		{
+			PyErr_SetString(PyExc_ValueError, "out must have the same length as lat and lon");
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Hand result to the caller, the buffers are released when the batch goes out of scope.
+	 */
+	PyObject *release_result()
+	{
+		PyObject *r = result;
+		result = nullptr;
+		return r;
+	}
+};
+
+/**
+ * @brief geofence.Fence, immutable once built so it can be queried from several threads with the GIL released.
+ */
+typedef struct
+{
+	PyObject_HEAD GeoFence *fence;
+} GeoFence_PyFence;
+
+static PyObject *GeoFence_PyFenceType = nullptr;    // heap type created by PyInit_geofence()
+
+static int fence_init(GeoFence_PyFence *self, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"coordinates", nullptr};
+	PyObject *coordinates;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", (char **)keywords, &coordinates)) return -1;
+	if (self->fence)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "Fence is immutable, create a new one");    // another thread may be querying it
+		return -1;
+	}
+	PyObject *sequence = PySequence_Fast(coordinates, "coordinates must be a sequence of (latitude, longitude) pairs");
+	if (!sequence) return -1;
+
+	std::vector<GPS_Coordinate> points;
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+	points.reserve(count);
+	for (Py_ssize_t i = 0; i < count; i++)
+	{
+		double lat, lon;
+		if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(sequence, i), "dd;coordinates must be (latitude, longitude) pairs", &lat, &lon))
+		{
+			Py_DECREF(sequence);
+			return -1;
+		}
+		points.emplace_back((float)lat, (float)lon);
+	}
+	Py_DECREF(sequence);
+	if (points.size() < 3)
+	{
+		PyErr_SetString(PyExc_ValueError, "a fence needs at least 3 vertices");
+		return -1;
+	}
+
+	GeoFence *fence = new GeoFence();
+	fence->boundary_coordinates = std::move(points);
+	fence->rebuild_index();
+	self->fence = fence;
+	return 0;
+}
+
+static void fence_dealloc(GeoFence_PyFence *self)
+{
+	PyTypeObject *type = Py_TYPE(self);
+	delete self->fence;
+	type->tp_free((PyObject *)self);
+	Py_DECREF(type);
+}
+
+static bool fence_ready(GeoFence_PyFence *self)
+{
+	if (self->fence) return true;
+	PyErr_SetString(PyExc_RuntimeError, "Fence was not initialized");
+	return false;
+}
+
+static Py_ssize_t fence_len(GeoFence_PyFence *self) { return self->fence ? (Py_ssize_t)self->fence->boundary_coordinates.size() : 0; }
+
+static PyObject *fence_contains(GeoFence_PyFence *self, PyObject *args)
+{
+	float lat, lon;
+	if (!fence_ready(self) || !PyArg_ParseTuple(args, "ff", &lat, &lon)) return nullptr;
+	return PyBool_FromLong(self->fence->is_inside(GPS_Coordinate(lat, lon)));
+}
+
+static PyObject *fence_is_inside(GeoFence_PyFence *self, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"lat", "lon", "out", nullptr};
+	PyObject *lat_obj, *lon_obj, *out_obj = nullptr;
+	if (!fence_ready(self) || !PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O", (char **)keywords, &lat_obj, &lon_obj, &out_obj))
+		return nullptr;
+	GeoFence_PyBatch batch;
+	if (!batch.acquire(lat_obj, lon_obj, out_obj, "?bB", 1, "?")) return nullptr;
+
+	const GeoFence &fence = *self->fence;
+	Py_BEGIN_ALLOW_THREADS;
+	for (Py_ssize_t i = 0; i < batch.lat.size(); i++)
+		*batch.out.at(i) = fence.is_inside(GPS_Coordinate(batch.lat.get_float(i), batch.lon.get_float(i))) ? 1 : 0;
+	Py_END_ALLOW_THREADS;
+	return batch.release_result();
+}
+
+static PyObject *fence_distance_to_boundary(GeoFence_PyFence *self, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"lat", "lon", "out", nullptr};
+	PyObject *lat_obj, *lon_obj, *out_obj = nullptr;
+	if (!fence_ready(self) || !PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O", (char **)keywords, &lat_obj, &lon_obj, &out_obj))
+		return nullptr;
+	GeoFence_PyBatch batch;
+	if (!batch.acquire(lat_obj, lon_obj, out_obj, "df", sizeof(double), "d")) return nullptr;
+
+	const GeoFence &fence = *self->fence;
+	Py_BEGIN_ALLOW_THREADS;
+	for (Py_ssize_t i = 0; i < batch.lat.size(); i++)
+		batch.out.set_double(i, fence.distance_to_boundary(GPS_Coordinate(batch.lat.get_float(i), batch.lon.get_float(i))));
+	Py_END_ALLOW_THREADS;
+	return batch.release_result();
+}
+
+static PyObject *fence_coordinates(GeoFence_PyFence *self, PyObject *)
+{
+	if (!fence_ready(self)) return nullptr;
+	const std::vector<GPS_Coordinate> &points = self->fence->boundary_coordinates;
+	PyObject *list = PyList_New((Py_ssize_t)points.size());
+	if (!list) return nullptr;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		PyObject *pair = Py_BuildValue("(dd)", (double)points[i].latitude, (double)points[i].longitude);
+		if (!pair)
+		{
+			Py_DECREF(list);
+			return nullptr;
+		}
+		PyList_SET_ITEM(list, (Py_ssize_t)i, pair);
+	}
+	return list;
+}
+
+static PyObject *fence_bounding_box(GeoFence_PyFence *self, PyObject *)
+{
+	if (!fence_ready(self)) return nullptr;
+	const GeoFence_BoundingBox &box = self->fence->bounding_box();
+	return Py_BuildValue("(dddd)", (double)box.min_latitude, (double)box.min_longitude, (double)box.max_latitude, (double)box.max_longitude);
+}
+
+static PyMethodDef fence_methods[] = {
+    {"contains", (PyCFunction)fence_contains, METH_VARARGS, "contains(lat, lon) -> bool, one point"},
+    {"is_inside", (PyCFunction)(void (*)(void))fence_is_inside, METH_VARARGS | METH_KEYWORDS,
+     "is_inside(lat, lon, out=None) -> bool array, out may be a bool/uint8/int8 array of the same length"},
+    {"distance_to_boundary", (PyCFunction)(void (*)(void))fence_distance_to_boundary, METH_VARARGS | METH_KEYWORDS,
+     "distance_to_boundary(lat, lon, out=None) -> float64 array of meters, out may be float64 or float32"},
+    {"coordinates", (PyCFunction)fence_coordinates, METH_NOARGS, "coordinates() -> list of (latitude, longitude)"},
+    {"bounding_box", (PyCFunction)fence_bounding_box, METH_NOARGS, "bounding_box() -> (min_lat, min_lon, max_lat, max_lon)"},
+    {nullptr, nullptr, 0, nullptr}};
+
+static PyType_Slot fence_slots[] = {
+    {Py_tp_doc, (void *)"Fence(coordinates), coordinates is a sequence of (latitude, longitude) pairs in decimal degrees"},
+    {Py_tp_new, (void *)PyType_GenericNew},
+    {Py_tp_init, (void *)fence_init},
+    {Py_tp_dealloc, (void *)fence_dealloc},
+    {Py_tp_methods, (void *)fence_methods},
+    {Py_sq_length, (void *)fence_len},
+    {0, nullptr}};
+
+static PyType_Spec fence_spec = {"geofence.Fence", sizeof(GeoFence_PyFence), 0, Py_TPFLAGS_DEFAULT, fence_slots};
+
+/**
+ * @brief first_containing(fences, lat, lon, out=None), index of the first fence of the list that contains each point, or -1.
+ */
+static PyObject *module_first_containing(PyObject *, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"fences", "lat", "lon", "out", nullptr};
+	PyObject *fences_obj, *lat_obj, *lon_obj, *out_obj = nullptr;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO|O", (char **)keywords, &fences_obj, &lat_obj, &lon_obj, &out_obj)) return nullptr;
+	// a tuple of our own holds a reference to every fence: with the GIL released another thread may empty the caller's list, which
+	// would free a fence still being queried
+	PyObject *sequence = PySequence_Tuple(fences_obj);
+	if (!sequence) return nullptr;
+
+	std::vector<const GeoFence *> fences;
+	for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(sequence); i++)
+	{
+		PyObject *item = PyTuple_GET_ITEM(sequence, i);
+		if (!PyObject_TypeCheck(item, (PyTypeObject *)GeoFence_PyFenceType) || !fence_ready((GeoFence_PyFence *)item))
+		{
+			if (!PyErr_Occurred()) PyErr_SetString(PyExc_TypeError, "fences must be a sequence of Fence");
+			Py_DECREF(sequence);
+			return nullptr;
+		}
+		fences.push_back(((GeoFence_PyFence *)item)->fence);
+	}
+
+	GeoFence_PyBatch batch;
+	if (!batch.acquire(lat_obj, lon_obj, out_obj, "ilq", sizeof(int32_t), "i"))
+	{
+		Py_DECREF(sequence);
+		return nullptr;
+	}
+	if (batch.out.view.itemsize != 4 && batch.out.view.itemsize != 8)
+	{
+		PyErr_SetString(PyExc_TypeError, "out must hold 4 or 8 byte integers");
+		Py_DECREF(sequence);
+		return nullptr;
+	}
+	Py_BEGIN_ALLOW_THREADS;
+	for (Py_ssize_t i = 0; i < batch.lat.size(); i++)
+	{
+		GPS_Coordinate p(batch.lat.get_float(i), batch.lon.get_float(i));
+		long long found = -1;
+		for (size_t f = 0; f < fences.size(); f++)
+		{
+			if (fences[f]->is_inside(p))
+			{
+				found = (long long)f;
+				break;
+			}
+		}
+		batch.out.set_int(i, found);
+	}
+	Py_END_ALLOW_THREADS;
+	Py_DECREF(sequence);
+	return batch.release_result();
+}
+
+static PyMethodDef module_methods[] = {
+    {"first_containing", (PyCFunction)(void (*)(void))module_first_containing, METH_VARARGS | METH_KEYWORDS,
+     "first_containing(fences, lat, lon, out=None) -> int32 array, index of the first fence containing each point or -1"},
+    {nullptr, nullptr, 0, nullptr}};
+
+static PyModuleDef geofence_module = {PyModuleDef_HEAD_INIT, "geofence", "Batch geofence queries over NumPy / buffer arrays.", -1,
+                                      module_methods, nullptr, nullptr, nullptr, nullptr};
+
+PyMODINIT_FUNC PyInit_geofence(void)
+{
+	PyObject *module = PyModule_Create(&geofence_module);
+	if (!module) return nullptr;
+	GeoFence_PyFenceType = PyType_FromSpec(&fence_spec);
+	if (!GeoFence_PyFenceType)
+	{
+		Py_DECREF(module);
+		return nullptr;
+	}
+	Py_INCREF(GeoFence_PyFenceType);
+	if (PyModule_AddObject(module, "Fence", GeoFence_PyFenceType) < 0)
+	{
+		Py_DECREF(GeoFence_PyFenceType);
+		Py_DECREF(module);
+		return nullptr;
+	}
+	return module;
+}
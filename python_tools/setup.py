@@ -0,0 +1,18 @@
+"""Builds the native geofence module: python3 setup.py build_ext --inplace"""
+import sys
+from setuptools import setup, Extension
+
+setup(
+    name="geofence",
+    version="1.0.0",
+    description="Batch geofence queries over NumPy arrays, backed by geofence.h",
+    ext_modules=[
+        Extension(
+            "geofence",
+            sources=["geofence_module.cpp"],
+            include_dirs=[".."],
+            language="c++",
+            extra_compile_args=[] if sys.platform == "win32" else ["-O2", "-std=c++17"],
+        )
+    ],
+)
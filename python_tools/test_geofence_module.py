@@ -0,0 +1,82 @@
+"""Checks the native geofence module against results printed by geofence.h for the same fences and points.
+Build the module first (python3 setup.py build_ext --inplace), then run: python3 test_geofence_module.py"""
+import array
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import geofence
+
+SIMOVA = [(-23.207486, -45.907859), (-23.209189, -45.909029), (-23.211687, -45.909443), (-23.212556, -45.902455)]
+CONCAVE = [(-23.2100, -45.9100), (-23.2100, -45.9000), (-23.2080, -45.9000), (-23.2080, -45.9060), (-23.2040, -45.9060),
+           (-23.2040, -45.9100)]
+
+# latitude, longitude, is_inside() and distance_to_boundary() of both fences, first_containing([SIMOVA, CONCAVE]), from the C++ library
+EXPECTED = [
+    (-23.2130, -45.9095, 0, 0, 145.380810, 333.611955, -1),
+    (-23.2130, -45.9070, 0, 0, 111.112097, 333.606247, -1),
+    (-23.2130, -45.9045, 0, 0, 76.795423, 333.604929, -1),
+    (-23.2130, -45.9020, 0, 0, 67.625072, 333.608004, -1),
+    (-23.2110, -45.9095, 0, 0, 17.323753, 111.344265, -1),
+    (-23.2110, -45.9070, 1, 0, 109.145075, 111.338557, 0),
+    (-23.2110, -45.9045, 1, 0, 28.164012, 111.337239, 0),
+    (-23.2110, -45.9020, 0, 0, 154.246120, 111.340314, -1),
+    (-23.2090, -45.9095, 0, 1, 52.704108, 51.070084, 1),
+    (-23.2090, -45.9070, 1, 1, 55.173926, 111.141223, 0),
+    (-23.2090, -45.9045, 0, 1, 127.520508, 111.131476, 1),
+    (-23.2090, -45.9020, 0, 1, 309.933370, 111.131037, 1),
+    (-23.2070, -45.9095, 0, 1, 170.554894, 51.070848, 1),
+    (-23.2070, -45.9070, 0, 1, 100.359448, 102.531548, 1),
+    (-23.2070, -45.9045, 0, 0, 283.056613, 111.136215, -1),
+    (-23.2070, -45.9020, 0, 0, 465.472204, 111.136654, -1),
+    (-23.2050, -45.9095, 0, 1, 323.221055, 51.071612, 1),
+    (-23.2050, -45.9070, 0, 1, 289.937408, 102.533084, 1),
+    (-23.2050, -45.9045, 0, 0, 438.741131, 153.214836, -1),
+    (-23.2050, -45.9020, 0, 0, 621.159453, 333.616432, -1),
+]
+
+
+class TestGeofenceModule(unittest.TestCase):
+    def setUp(self):
+        self.fences = [geofence.Fence(SIMOVA), geofence.Fence(CONCAVE)]
+        self.lat = array.array('d', [row[0] for row in EXPECTED])
+        self.lon = array.array('d', [row[1] for row in EXPECTED])
+
+    def test_contains(self):
+        for row in EXPECTED:
+            for f, fence in enumerate(self.fences):
+                self.assertEqual(fence.contains(row[0], row[1]), bool(row[2 + f]), row)
+
+    def test_is_inside(self):
+        for f, fence in enumerate(self.fences):
+            self.assertEqual(fence.is_inside(self.lat, self.lon).tolist(), [bool(row[2 + f]) for row in EXPECTED])
+
+    def test_distance_to_boundary(self):
+        for f, fence in enumerate(self.fences):
+            for got, row in zip(fence.distance_to_boundary(self.lat, self.lon).tolist(), EXPECTED):
+                self.assertAlmostEqual(got, row[4 + f], delta=1e-5)
+            out = array.array('f', [0] * len(EXPECTED))
+            self.assertIs(fence.distance_to_boundary(self.lat, self.lon, out=out), out)
+            for got, row in zip(out.tolist(), EXPECTED):
+                self.assertAlmostEqual(got, row[4 + f], delta=1e-3)
+
+    def test_first_containing(self):
+        expected = [row[6] for row in EXPECTED]
+        self.assertEqual(geofence.first_containing(self.fences, self.lat, self.lon).tolist(), expected)
+        for typecode in 'ilq':    # int32, C long (int64 on Linux, like numpy's default int) and int64
+            out = array.array(typecode, [9] * len(EXPECTED))
+            geofence.first_containing(tuple(self.fences), self.lat, self.lon, out=out)
+            self.assertEqual(out.tolist(), expected, typecode)
+        with self.assertRaises(TypeError):
+            geofence.first_containing(self.fences, self.lat, self.lon, out=array.array('h', [0] * len(EXPECTED)))
+        with self.assertRaises(TypeError):
+            geofence.first_containing([self.fences[0], 1], self.lat, self.lon)
+
+    def test_immutable(self):
+        with self.assertRaises(RuntimeError):
+            self.fences[0].__init__(CONCAVE)
+
+
+if __name__ == "__main__":
+    unittest.main()